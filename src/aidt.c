@@ -1,16 +1,133 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "sample.h"
 #include "dtree.h"
+#include "shard.h"
+#include "score.h"
+#include "profile.h"
+#include "inspect.h"
+#include "spill.h"
+#include "sweep.h"
+#include "forest.h"
+#include "table.h"
+#include "multi.h"
 
 //#define SIMPLE_SET 
 
+/* The model file reloaded by dt score -r, and its modification time when
+ * it was last loaded
+ */
+struct model_watch {
+	const char *path;
+	struct timespec mtime;
+};
+
+
+static struct decision* load_model(const char *path);
+static void reload_model(struct dt_handle*, void *ctx);
+static bool save_model(const struct decision*, const char *path);
+static int run_sweep(const struct sample*, int count, int threads);
+static int run_forest(const struct sample*, int count, int ntrees, int extra,
+					  int threads);
+static int run_check(const struct sample*, int count, int extra);
+static double seconds_since(const struct timespec*);
+
 
 int main(int argc, char **argv) {
-	const bool interactive = (argc == 2 && !strcmp(argv[1], "-i")) ;
+	bool interactive = false;
+	bool lazy = false;
+	bool reload = false;
+	int shards = 0;
+	int threads = 4;
+	const char *score_in = NULL;
+	const char *score_out = NULL;
+	const char *model_in = NULL;
+	const char *model_out = NULL;
+	const char *export = NULL;
+	const char *cache_dir = NULL;
+	const char *train = NULL;
+	long memory = 0;
+	bool compress = false;
+	bool sweep = false;
+	bool check = false;
+	int extra = 0;
+	int forest = 0;
+	long table_size = 0;
+	enum dt_format format = DT_FORMAT_PATH;
+
+	for (int i=1; i<argc; i++) {
+		if (i == 1 && !strcmp(argv[i], "score") && argc >= 4) {
+			score_in = argv[++i];
+			score_out = argv[++i];
+		} else if (!strcmp(argv[i], "-j") && i+1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-i")) {
+			interactive = true;
+		} else if (!strcmp(argv[i], "-s") && i+1 < argc) {
+			shards = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-l") && i+1 < argc) {
+			model_in = argv[++i];
+		} else if (!strcmp(argv[i], "-p") && i+1 < argc) {
+			model_out = argv[++i];
+		} else if (!strcmp(argv[i], "-f") && i+1 < argc) {
+			train = argv[++i];
+		} else if (!strcmp(argv[i], "-m") && i+1 < argc) {
+			memory = atol(argv[++i]) << 20;
+		} else if (!strcmp(argv[i], "-z")) {
+			compress = true;
+		} else if (!strcmp(argv[i], "-w")) {
+			sweep = true;
+		} else if (!strcmp(argv[i], "-k")) {
+			check = true;
+		} else if (!strcmp(argv[i], "-x") && i+1 < argc) {
+			extra = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-t") && i+1 < argc) {
+			forest = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-d") && i+1 < argc) {
+			table_size = atol(argv[++i]);
+		} else if (!strcmp(argv[i], "-g")) {
+			lazy = true;
+		} else if (!strcmp(argv[i], "-r")) {
+			reload = true;
+		} else if (!strcmp(argv[i], "-c") && i+1 < argc) {
+			cache_dir = argv[++i];
+		} else if (!strcmp(argv[i], "-e") && i+1 < argc &&
+				   dt_format_parse(argv[i+1], &format)) {
+			export = argv[++i];
+		} else {
+			printf("usage: %s [-i] [-s shards] [-l model] [-p model] "
+				   "[-c dir] [-x candidates] [-e path|json|dot]\n"
+				   "       %s -f samples [-m megabytes] [-z] ...\n"
+				   "       %s -w [-j threads]\n"
+				   "       %s -t trees [-x candidates] [-j threads]\n"
+				   "       %s -k [-x candidates]\n"
+				   "       %s score <input> <output> [-j threads] [-s shards] "
+				   "[-l model [-r]] [-g] [-d entries]\n",
+				   argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+			exit(1);
+		}
+	}
+
+	// Only a loaded model can be reloaded, and a compiled table is not
+	if (reload && (!score_in || !model_in || table_size > 0)) {
+		printf("ERROR: -r needs score and -l, and cannot be combined "
+			   "with -d\n");
+		exit(1);
+	}
+
+	// Sweeps, forests and checks print tables instead of a tree
+	if (export && (sweep || forest > 0 || check)) {
+		printf("ERROR: -e cannot be combined with -w, -t or -k\n");
+		exit(1);
+	}
 
 	// Sample data
 #ifdef SIMPLE_SET
@@ -71,14 +188,103 @@ int main(int argc, char **argv) {
 	
 	//sample_stats(samples, num_samples);
 
+	// The training log goes to stderr while exporting, leaving stdout to
+	// the exported tree
+	int stdout_fd = -1;
+	if (export) {
+		fflush(stdout);
+		stdout_fd = dup(STDOUT_FILENO);
+		dup2(STDERR_FILENO, STDOUT_FILENO);
+	}
+
 	printf("Initial entropy: %g\n\n", set_entropy(samples, num_samples));
 
-	struct decision *dec = dt_create(samples, num_samples);
+	if (sweep)
+		return run_sweep(samples, num_samples, threads);
+	if (forest > 0)
+		return run_forest(samples, num_samples, forest, extra, threads);
+	if (check)
+		return run_check(samples, num_samples, extra);
+
+	struct dt_params params;
+	dt_params_default(&params);
+	params.cache_dir = cache_dir;
+	params.lazy = lazy;
+	params.compress = compress;
+	params.extra = extra;
+	if (memory > 0)
+		params.memory = memory;
+
+	struct decision *dec;
+	if (model_in)
+		dec = load_model(model_in);
+	else if (shards > 0)
+		dec = dt_create_sharded_samples(samples, num_samples, shards, &params);
+	else if (train)
+		dec = dt_create_spilled(train, &params);
+	else
+		dec = dt_create_params(samples, num_samples, &params);
 	if (!dec) {
 		printf("ERROR: dt_create() returned NULL\n");
 		exit(1);
 	}
 
+	if (score_in && table_size > 0) {
+		dt_grow(dec);
+		struct dt_table *table = dt_compile(dec, table_size);
+		if (table->decisions)
+			fprintf(stderr, "%li decisions compiled\n", table->size);
+		else
+			fprintf(stderr, "Domain too large, deciding by the tree\n");
+
+		long rows = dt_score_table_file(table, score_in, score_out, threads);
+		dt_table_destroy(table);
+		dt_destroy(dec);
+		if (rows < 0)
+			return 1;
+		fprintf(stderr, "%li rows scored\n", rows);
+		return 0;
+	}
+
+	if (score_in && reload) {
+		struct model_watch watch;
+		struct stat st;
+		memset(&watch, 0, sizeof(watch));
+		watch.path = model_in;
+		if (stat(model_in, &st) == 0)
+			watch.mtime = st.st_mtim;
+
+		struct dt_handle *handle = dt_handle_create(dec);
+		long rows = dt_score_handle_file(handle, score_in, score_out, threads,
+										 reload_model, &watch);
+		dt_handle_destroy(handle);
+		if (rows < 0)
+			return 1;
+		fprintf(stderr, "%li rows scored\n", rows);
+		return 0;
+	}
+
+	if (score_in) {
+		long rows = dt_score_file(dec, score_in, score_out, threads);
+		dt_destroy(dec);
+		if (rows < 0)
+			return 1;
+		fprintf(stderr, "%li rows scored\n", rows);
+		return 0;
+	}
+
+	// The rest walks the entire tree
+	dt_grow(dec);
+
+	if (export) {
+		fflush(stdout);
+		dup2(stdout_fd, STDOUT_FILENO);
+		close(stdout_fd);
+		dt_export(dec, stdout, format);
+		dt_destroy(dec);
+		return 0;
+	}
+
 	dt_assert_valid(dec);
 
 	print_decision_tree(dec, stdout);
@@ -106,7 +312,11 @@ int main(int argc, char **argv) {
 	} else {
 		int pass = 0;
 		for (int i=0; i<num_samples; i++) {
-			int res = dt_decide(dec, &samples[i]);
+			int res;
+			if (model_out)
+				res = dt_decide_profile(dec, &samples[i]);
+			else
+				res = dt_decide(dec, &samples[i]);
 
 			if (res == -1)
 				printf("No decision available for student %i\n", i+1);
@@ -120,8 +330,248 @@ int main(int argc, char **argv) {
 		printf("%i pass\n%i fail\n", pass, num_samples-pass);
 	}
 
-	
+	if (model_out && !save_model(dec, model_out))
+		printf("ERROR: unable to save model to %s\n", model_out);
 
 	dt_destroy(dec);
 	return 0;
 }
+
+
+/* Load a model saved by save_model(). If the model was saved with a
+ * profile, the tree is laid out according to it.
+ */
+static struct decision*
+load_model(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (!file)
+		return NULL;
+	struct decision *dec = dt_load(file);
+	fclose(file);
+	if (!dec)
+		return NULL;
+
+	char prof[1024];
+	snprintf(prof, sizeof(prof), "%s.prof", path);
+	file = fopen(prof, "r");
+	if (file) {
+		if (dt_profile_load(dec, file)) {
+			struct decision *flat = dt_relayout(dec);
+			dt_destroy(dec);
+			dec = flat;
+		} else {
+			printf("WARNING: profile %s does not match the model\n", prof);
+		}
+		fclose(file);
+	}
+
+	return dec;
+}
+
+/* Publish the model of a struct model_watch to the handle if its file
+ * was modified since it was last loaded. Models should be renamed into
+ * place, so that a partial file is never loaded; an invalid file is
+ * skipped until it is modified again.
+ */
+static void
+reload_model(struct dt_handle *handle, void *ctx)
+{
+	struct model_watch *watch = (struct model_watch*)ctx;
+	struct stat st;
+	if (stat(watch->path, &st) != 0 ||
+		(st.st_mtim.tv_sec == watch->mtime.tv_sec &&
+		 st.st_mtim.tv_nsec == watch->mtime.tv_nsec))
+		return;
+	watch->mtime = st.st_mtim;
+
+	struct decision *dec = load_model(watch->path);
+	if (!dec) {
+		fprintf(stderr, "WARNING: unable to reload %s\n", watch->path);
+		return;
+	}
+
+	dt_handle_publish(handle, dec);
+	fprintf(stderr, "Reloaded %s\n", watch->path);
+}
+
+/* Save the model to [path] and its profile to [path].prof
+ */
+static bool
+save_model(const struct decision *dec, const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (!file)
+		return false;
+	bool ok = dt_save(dec, file);
+	ok = (fclose(file) == 0) && ok;
+
+	char prof[1024];
+	snprintf(prof, sizeof(prof), "%s.prof", path);
+	file = fopen(prof, "w");
+	if (!file)
+		return false;
+	ok = dt_profile_save(dec, file) && ok;
+	ok = (fclose(file) == 0) && ok;
+
+	return ok;
+}
+
+/* Sweep a small grid over the samples, holding out every fourth sample
+ */
+static int
+run_sweep(const struct sample *samples, int count, int threads)
+{
+	struct sample *train = (struct sample*)malloc(sizeof(struct sample) * count);
+	struct sample *holdout = (struct sample*)malloc(sizeof(struct sample) * count);
+	int ntrain = 0;
+	int nholdout = 0;
+	for (int i=0; i<count; i++) {
+		if (i % 4 == 3)	holdout[nholdout++] = samples[i];
+		else			train[ntrain++] = samples[i];
+	}
+
+	const int max_depth[] = { 1, 2, 3, 0 };
+	const int min_leaf[] = { 1, 2, 4 };
+	const enum count_criterion criterion[] = { COUNT_ENTROPY, COUNT_GINI };
+
+	struct dt_params base;
+	dt_params_default(&base);
+
+	struct dt_sweep sweep;
+	sweep.base = &base;
+	sweep.max_depth = max_depth;
+	sweep.n_max_depth = 4;
+	sweep.min_leaf = min_leaf;
+	sweep.n_min_leaf = 3;
+	sweep.criterion = criterion;
+	sweep.n_criterion = 2;
+	sweep.threads = threads;
+
+	struct dt_sweep_result *results = NULL;
+	int n = dt_sweep(train, ntrain, holdout, nholdout, &sweep, &results);
+	dt_sweep_print(results, n, stdout);
+
+	free(results);
+	free(train);
+	free(holdout);
+	return 0;
+}
+
+/* Train a forest and a single tree on three quarters of the samples, and
+ * print the time and the accuracy on the rest for both
+ */
+static int
+run_forest(const struct sample *samples, int count, int ntrees, int extra,
+		   int threads)
+{
+	struct sample *train = (struct sample*)malloc(sizeof(struct sample) * count);
+	struct sample *holdout = (struct sample*)malloc(sizeof(struct sample) * count);
+	int ntrain = 0;
+	int nholdout = 0;
+	for (int i=0; i<count; i++) {
+		if (i % 4 == 3)	holdout[nholdout++] = samples[i];
+		else			train[ntrain++] = samples[i];
+	}
+
+	struct dt_params params;
+	dt_params_default(&params);
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	struct decision *tree = dt_create_params(train, ntrain, &params);
+	const double tree_time = seconds_since(&start);
+
+	params.extra = extra;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	struct dt_forest *forest = dt_forest_create(train, ntrain, &params, ntrees,
+												threads);
+	const double forest_time = seconds_since(&start);
+
+	int tree_correct = 0;
+	int forest_correct = 0;
+	for (int i=0; i<nholdout; i++) {
+		const int res = field_value(&holdout[i], SAMPLE_RESULT_FIELD);
+		if (dt_decide(tree, &holdout[i]) == res)
+			tree_correct++;
+		if (forest && dt_forest_decide(forest, &holdout[i]) == res)
+			forest_correct++;
+	}
+
+	printf("model       seconds  accuracy\n");
+	printf("tree       %8.6f  %8.4f\n", tree_time,
+		   nholdout ? (double)tree_correct / nholdout : 0.0);
+	printf("forest %3i %8.6f  %8.4f\n", ntrees, forest_time,
+		   nholdout ? (double)forest_correct / nholdout : 0.0);
+
+	dt_destroy(tree);
+	dt_forest_destroy(forest);
+	free(train);
+	free(holdout);
+	return forest ? 0 : 1;
+}
+
+/* Train trees for several labelings of the samples in one multi-target
+ * job, and check that each equals the tree dt_create_params() trains on
+ * the samples relabeled with its labels alone
+ */
+static int
+run_check(const struct sample *samples, int count, int extra)
+{
+	const char *names[] = { "pass", "fail", "topic is GAMES", "ass2 >= 10" };
+	const int ntargets = 4;
+	int *labels[4];
+	for (int t=0; t<ntargets; t++)
+		labels[t] = (int*)malloc(sizeof(int) * count);
+	for (int i=0; i<count; i++) {
+		labels[0][i] = samples[i].pass;
+		labels[1][i] = !samples[i].pass;
+		labels[2][i] = samples[i].topic == GAMES;
+		labels[3][i] = samples[i].ass2 >= ASS_10;
+	}
+
+	struct dt_params params;
+	dt_params_default(&params);
+	params.extra = extra;
+
+	struct decision *trees[4];
+	dt_create_multi(samples, count, (const int *const *)labels, ntargets,
+					&params, trees);
+
+	bool same[4];
+	struct sample *relabeled = (struct sample*)malloc(sizeof(struct sample)
+													  * count);
+	for (int t=0; t<ntargets; t++) {
+		memcpy(relabeled, samples, sizeof(struct sample) * count);
+		for (int i=0; i<count; i++)
+			set_field_value(&relabeled[i], SAMPLE_RESULT_FIELD, labels[t][i]);
+
+		struct decision *single = dt_create_params(relabeled, count, &params);
+		same[t] = dt_equal(trees[t], single);
+		dt_destroy(single);
+	}
+
+	printf("[CHECKING MULTI-TARGET TRAINING]\n");
+	int failed = 0;
+	for (int t=0; t<ntargets; t++) {
+		printf("\tTarget \"%s\": %s\n", names[t],
+			   same[t] ? "same tree as a single target"
+					   : "[ERROR] differs from a single target");
+		if (!same[t])
+			failed++;
+		dt_destroy(trees[t]);
+		free(labels[t]);
+	}
+
+	free(relabeled);
+	return failed ? 1 : 0;
+}
+
+static double
+seconds_since(const struct timespec *start)
+{
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (double)(end.tv_sec - start->tv_sec)
+		   + (double)(end.tv_nsec - start->tv_nsec) / 1e9;
+}
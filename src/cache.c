@@ -0,0 +1,332 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <time.h>
+#include <sys/stat.h>
+
+
+#define FNV_OFFSET	14695981039346656037ULL
+#define FNV_PRIME	1099511628211ULL
+
+// Temporary files older than this, in seconds, were left by a crashed writer
+#define CACHE_TMP_AGE	3600
+
+struct cache_file {
+	unsigned long long key;
+	time_t mtime;
+	long size;
+};
+
+static unsigned long long fnv_int(unsigned long long h, int v);
+static bool cache_path(char *buf, size_t sz, const char *dir,
+					   unsigned long long key, const char *ext);
+static bool cache_mkdir(const char *dir);
+static void cache_evict(const char *dir, unsigned long long keep, long max_size);
+static bool cache_remove(const char *dir, unsigned long long key, bool model);
+static bool cache_file_key(const char *name, const char *ext,
+						   unsigned long long *key);
+static void cache_file_push(struct cache_file**, int *count, int *cap,
+							const struct cache_file*);
+static int cache_file_cmp(const void*, const void*);
+
+
+
+unsigned long long
+dt_cache_key(const struct sample *samples, int count,
+			 const struct dt_params *params)
+{
+	unsigned long long h = FNV_OFFSET;
+	h = fnv_int(h, DT_CACHE_VERSION);
+	h = fnv_int(h, params->max_branch);
+	h = fnv_int(h, params->max_depth);
+	h = fnv_int(h, params->min_leaf);
+	h = fnv_int(h, params->criterion);
+	if (params->extra > 0) {
+		h = fnv_int(h, params->extra);
+		h = fnv_int(h, (int)(params->seed & 0xffffffffUL));
+		h = fnv_int(h, (int)((unsigned long long)params->seed >> 32));
+	}
+	h = fnv_int(h, count);
+
+	for (int i=0; i<count; i++) {
+		for (int j=0; j<SAMPLE_NUM_FIELDS; j++)
+			h = fnv_int(h, field_value(&samples[i], j));
+	}
+
+	return h;
+}
+
+struct decision*
+dt_cache_load(const char *dir, unsigned long long key)
+{
+	char path[1024];
+	if (!cache_path(path, sizeof(path), dir, key, "dt"))
+		return NULL;
+
+	FILE *file = fopen(path, "r");
+	if (!file)
+		return NULL;
+	struct decision *dec = dt_load(file);
+	fclose(file);
+
+	if (dec)
+		utime(path, NULL);
+	return dec;
+}
+
+bool
+dt_cache_store(const char *dir, unsigned long long key,
+			   const struct decision *dec, long max_size)
+{
+	if (!cache_mkdir(dir))
+		return false;
+
+	// The temporary name is the model path with a suffix
+	char path[1024];
+	char tmp[sizeof(path) + 32];
+	if (!cache_path(path, sizeof(path), dir, key, "dt"))
+		return false;
+	int n = snprintf(tmp, sizeof(tmp), "%s.%li.tmp", path, (long)getpid());
+	if (n < 0 || (size_t)n >= sizeof(tmp))
+		return false;
+
+	FILE *file = fopen(tmp, "w");
+	if (!file)
+		return false;
+
+	bool ok = dt_save(dec, file);
+	ok = (fflush(file) == 0) && ok;
+	ok = (fsync(fileno(file)) == 0) && ok;
+	ok = (fclose(file) == 0) && ok;
+
+	if (!ok || rename(tmp, path) != 0) {
+		unlink(tmp);
+		return false;
+	}
+
+	if (max_size > 0)
+		cache_evict(dir, key, max_size);
+	return true;
+}
+
+int
+dt_cache_lock(const char *dir, unsigned long long key)
+{
+	if (!cache_mkdir(dir))
+		return -1;
+
+	char path[1024];
+	if (!cache_path(path, sizeof(path), dir, key, "lock"))
+		return -1;
+
+	struct flock fl;
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+
+	while (true) {
+		int fd = open(path, O_RDWR | O_CREAT, 0644);
+		if (fd < 0)
+			return -1;
+
+		while (fcntl(fd, F_SETLKW, &fl) < 0) {
+			if (errno != EINTR) {
+				close(fd);
+				return -1;
+			}
+		}
+
+		// Eviction removes lock files while holding them. A lock taken
+		// on a removed file excludes nobody, so lock the new one instead.
+		struct stat held;
+		struct stat named;
+		if (fstat(fd, &held) == 0 && stat(path, &named) == 0 &&
+			held.st_dev == named.st_dev && held.st_ino == named.st_ino)
+			return fd;
+		close(fd);
+	}
+}
+
+void
+dt_cache_unlock(int lock)
+{
+	// Closing the file releases the lock
+	if (lock >= 0)
+		close(lock);
+}
+
+
+static unsigned long long
+fnv_int(unsigned long long h, int v)
+{
+	unsigned u = (unsigned)v;
+	for (int i=0; i<4; i++) {
+		h ^= (u >> (8 * i)) & 0xff;
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+/* Returns false if the path does not fit in [sz] bytes.
+ */
+static bool
+cache_path(char *buf, size_t sz, const char *dir, unsigned long long key,
+		   const char *ext)
+{
+	int n = snprintf(buf, sz, "%s/%016llx.%s", dir, key, ext);
+	return n >= 0 && (size_t)n < sz;
+}
+
+static bool
+cache_mkdir(const char *dir)
+{
+	return mkdir(dir, 0755) == 0 || errno == EEXIST;
+}
+
+/* Remove the least recently used models, other than [keep], until the
+ * models in the directory take at most [max_size] bytes. Models whose key
+ * is locked are in use and stay. Lock files without a model and stale
+ * temporary files are removed as well.
+ */
+static void
+cache_evict(const char *dir, unsigned long long keep, long max_size)
+{
+	DIR *d = opendir(dir);
+	if (!d)
+		return;
+
+	struct cache_file *files = NULL;
+	int count = 0;
+	int cap = 0;
+	struct cache_file *locks = NULL;
+	int nlocks = 0;
+	int lock_cap = 0;
+	long total = 0;
+	const time_t now = time(NULL);
+
+	struct dirent *ent;
+	while ((ent = readdir(d))) {
+		struct cache_file f;
+		const bool model = cache_file_key(ent->d_name, ".dt", &f.key);
+		const bool lock = !model && cache_file_key(ent->d_name, ".lock", &f.key);
+		const size_t len = strlen(ent->d_name);
+		const bool tmp = len > 4 && !strcmp(ent->d_name + len - 4, ".tmp");
+		if (!model && !lock && !tmp)
+			continue;
+
+		char path[1024];
+		struct stat st;
+		int n = snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+		if (n < 0 || (size_t)n >= sizeof(path) || stat(path, &st) != 0)
+			continue;
+		f.mtime = st.st_mtime;
+		f.size = st.st_size;
+
+		if (tmp) {
+			if (now - st.st_mtime > CACHE_TMP_AGE)
+				unlink(path);
+		} else if (lock) {
+			if (f.key != keep)
+				cache_file_push(&locks, &nlocks, &lock_cap, &f);
+		} else {
+			total += st.st_size;
+			if (f.key != keep)
+				cache_file_push(&files, &count, &cap, &f);
+		}
+	}
+	closedir(d);
+
+	qsort(files, count, sizeof(struct cache_file), cache_file_cmp);
+
+	for (int i=0; i<count && total > max_size; i++) {
+		if (cache_remove(dir, files[i].key, true))
+			total -= files[i].size;
+	}
+
+	for (int i=0; i<nlocks; i++) {
+		char path[1024];
+		struct stat st;
+		if (cache_path(path, sizeof(path), dir, locks[i].key, "dt") &&
+			stat(path, &st) != 0 && errno == ENOENT)
+			cache_remove(dir, locks[i].key, false);
+	}
+
+	free(files);
+	free(locks);
+}
+
+/* Remove the lock file of [key] and, with [model], its model, unless
+ * another process holds the lock. The lock is held while the files are
+ * removed, and dt_cache_lock() does not keep a lock on a removed file.
+ * Returns false if the key is locked.
+ */
+static bool
+cache_remove(const char *dir, unsigned long long key, bool model)
+{
+	char path[1024];
+	char lock[1024];
+	if (!cache_path(path, sizeof(path), dir, key, "dt") ||
+		!cache_path(lock, sizeof(lock), dir, key, "lock"))
+		return false;
+
+	struct flock fl;
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+
+	int fd = open(lock, O_RDWR);
+	if (fd >= 0 && fcntl(fd, F_SETLK, &fl) < 0) {
+		close(fd);
+		return false;
+	}
+
+	bool ok = true;
+	if (model)
+		ok = unlink(path) == 0;
+	if (fd >= 0) {
+		unlink(lock);
+		close(fd);
+	}
+
+	return ok;
+}
+
+/* Whether [name] is "<16 hex digits>[ext]", assigning the digits to "key".
+ */
+static bool
+cache_file_key(const char *name, const char *ext, unsigned long long *key)
+{
+	if (strspn(name, "0123456789abcdef") != 16 || strcmp(name + 16, ext))
+		return false;
+
+	*key = strtoull(name, NULL, 16);
+	return true;
+}
+
+static void
+cache_file_push(struct cache_file **files, int *count, int *cap,
+				const struct cache_file *f)
+{
+	if (*count == *cap) {
+		*cap = *cap ? *cap * 2 : 16;
+		*files = (struct cache_file*)realloc(*files,
+											 sizeof(struct cache_file) * *cap);
+	}
+	(*files)[(*count)++] = *f;
+}
+
+static int
+cache_file_cmp(const void *a, const void *b)
+{
+	const struct cache_file *x = (const struct cache_file*)a;
+	const struct cache_file *y = (const struct cache_file*)b;
+	return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
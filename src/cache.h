@@ -0,0 +1,47 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "dtree.h"
+
+
+/* Model cache
+ * Models are stored as "<key>.dt" files in a cache directory, where the
+ * key is a hash of the training set and the training configuration.
+ * Files are written to a temporary name and renamed into place, so
+ * readers never see a partial model. Loading a model refreshes its
+ * modification time, which orders the eviction.
+ *
+ * Keys are locked through empty "<key>.lock" files. Eviction removes a
+ * model along with its lock file while holding the lock, and skips the
+ * models of locked keys. It also removes lock files left without a model
+ * and temporary files of crashed writers, so the directory holds about
+ * one lock file per cached model.
+ */
+
+// Bump when a change to training makes cached models stale
+#define DT_CACHE_VERSION 2
+
+/* Hash of the decision fields of the samples and of the parts of the
+ * configuration affecting the trained tree.
+ */
+unsigned long long dt_cache_key(const struct sample*, int count,
+								const struct dt_params*);
+
+/* Returns the cached model of [key], or NULL on a miss.
+ */
+struct decision* dt_cache_load(const char *dir, unsigned long long key);
+
+/* Store the model of [key], then evict the least recently used models
+ * until the cache holds at most [max_size] bytes. A [max_size] of zero
+ * disables eviction. The directory is created if missing.
+ */
+bool dt_cache_store(const char *dir, unsigned long long key,
+					const struct decision*, long max_size);
+
+/* Exclusive lock on [key] across processes. Returns a handle for
+ * dt_cache_unlock(), or -1 if the lock could not be taken.
+ */
+int dt_cache_lock(const char *dir, unsigned long long key);
+void dt_cache_unlock(int lock);
+
+#endif /* __CACHE_H__ */
@@ -0,0 +1,690 @@
+#include "counts.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+/* A value of the field considered by count_table_best_subset() */
+struct subset_value {
+	int value;
+	int count;
+	int first;		// Samples with the first result
+	int order;		// Order of appearance, breaking ties
+};
+
+static int count_table_find(const struct count_table*, unsigned, int, int);
+static int count_table_find_group(const struct count_table*, unsigned, int);
+static void count_table_rehash(struct count_table*, int nslots);
+static unsigned count_hash(unsigned field, int value, int result);
+
+static int subset_value_cmp(const void*, const void*);
+static double entropy2(int a, int n);
+static double gini2(int a, int n);
+static unsigned long long count_mix(unsigned long long);
+
+
+
+void
+count_table_init(struct count_table *t)
+{
+	memset(t, 0, sizeof(struct count_table));
+}
+
+void
+count_table_clear(struct count_table *t)
+{
+	t->size = 0;
+	t->ngroups = 0;
+	if (t->nslots) {
+		memset(t->entry_slot, 0, sizeof(int) * t->nslots);
+		memset(t->group_slot, 0, sizeof(int) * t->nslots);
+	}
+}
+
+void
+count_table_free(struct count_table *t)
+{
+	free(t->e);
+	free(t->link);
+	free(t->g);
+	free(t->entry_slot);
+	free(t->group_slot);
+	count_table_init(t);
+}
+
+void
+count_table_add(struct count_table *t, unsigned field, int value,
+				int result, int count)
+{
+	int i = count_table_find(t, field, value, result);
+	if (i >= 0) {
+		t->e[i].count += count;
+		t->g[count_table_find_group(t, field, value)].count += count;
+		return;
+	}
+
+	// Keep the load of the slots at or below one half
+	if ((t->size + 1) * 2 > t->nslots)
+		count_table_rehash(t, t->nslots ? t->nslots * 2 : 64);
+
+	if (t->size == t->cap) {
+		t->cap = t->cap ? t->cap * 2 : 16;
+		t->e = (struct count_entry*)realloc(t->e, sizeof(struct count_entry) * t->cap);
+		t->link = (int*)realloc(t->link, sizeof(int) * t->cap);
+	}
+
+	i = t->size++;
+	t->e[i].field = field;
+	t->e[i].value = value;
+	t->e[i].result = result;
+	t->e[i].count = count;
+	t->link[i] = -1;
+
+	const unsigned mask = t->nslots - 1;
+	unsigned h = count_hash(field, value, result) & mask;
+	while (t->entry_slot[h])
+		h = (h + 1) & mask;
+	t->entry_slot[h] = i + 1;
+
+	int g = count_table_find_group(t, field, value);
+	if (g >= 0) {
+		t->link[t->g[g].last] = i;
+		t->g[g].last = i;
+		t->g[g].count += count;
+		return;
+	}
+
+	if (t->ngroups == t->group_cap) {
+		t->group_cap = t->group_cap ? t->group_cap * 2 : 16;
+		int sz = sizeof(struct count_group) * t->group_cap;
+		t->g = (struct count_group*)realloc(t->g, sz);
+	}
+
+	g = t->ngroups++;
+	t->g[g].field = field;
+	t->g[g].value = value;
+	t->g[g].count = count;
+	t->g[g].first = i;
+	t->g[g].last = i;
+
+	h = count_hash(field, value, 0) & mask;
+	while (t->group_slot[h])
+		h = (h + 1) & mask;
+	t->group_slot[h] = g + 1;
+}
+
+void
+count_table_add_sample(struct count_table *t, const struct sample *sample)
+{
+	const int res = field_value(sample, SAMPLE_RESULT_FIELD);
+	for (int i=0; i<SAMPLE_NUM_FIELDS; i++)
+		count_table_add(t, i, field_value(sample, i), res, 1);
+}
+
+void
+count_table_merge(struct count_table *dst, const struct count_table *src)
+{
+	for (int i=0; i<src->size; i++) {
+		const struct count_entry *e = &src->e[i];
+		count_table_add(dst, e->field, e->value, e->result, e->count);
+	}
+}
+
+int
+count_table_total(const struct count_table *t)
+{
+	int total = 0;
+	for (int i=0; i<t->ngroups; i++) {
+		if (t->g[i].field == SAMPLE_RESULT_FIELD)
+			total += t->g[i].count;
+	}
+	return total;
+}
+
+int
+count_table_value_count(const struct count_table *t, unsigned field, int value)
+{
+	int g = count_table_find_group(t, field, value);
+	return g >= 0 ? t->g[g].count : 0;
+}
+
+double
+count_table_set_entropy(const struct count_table *t)
+{
+	const int count = count_table_total(t);
+
+	double e = 0.0;
+	for (int i=0; i<t->ngroups; i++) {
+		if (t->g[i].field != SAMPLE_RESULT_FIELD)
+			continue;
+		double f = (double)t->g[i].count / (double)count;
+		e -= f * log2(f);
+	}
+
+	return e;
+}
+
+double
+count_table_entropy(const struct count_table *t, unsigned field, int value)
+{
+	int g = count_table_find_group(t, field, value);
+	if (g < 0)
+		return 0.0;
+
+	// Entries of one group are ordered by first appearance of the
+	// result, just like the unique values in set_entropy().
+	const int count = t->g[g].count;
+	double e = 0.0;
+	for (int i=t->g[g].first; i>=0; i=t->link[i]) {
+		double f = (double)t->e[i].count / (double)count;
+		e -= f * log2(f);
+	}
+
+	return e;
+}
+
+double
+count_table_info_gain(const struct count_table *t, unsigned field)
+{
+	const int count = count_table_total(t);
+
+	double e = count_table_set_entropy(t);
+
+	for (int i=0; i<t->ngroups; i++) {
+		if (t->g[i].field != field)
+			continue;
+
+		double n = (double)t->g[i].count / (double)count;
+		n *= count_table_entropy(t, field, t->g[i].value);
+		e -= n;
+	}
+
+	return e;
+}
+
+double
+count_table_set_gini(const struct count_table *t)
+{
+	const int count = count_table_total(t);
+
+	double g = 1.0;
+	for (int i=0; i<t->ngroups; i++) {
+		if (t->g[i].field != SAMPLE_RESULT_FIELD)
+			continue;
+		double f = (double)t->g[i].count / (double)count;
+		g -= f * f;
+	}
+
+	return g;
+}
+
+double
+count_table_gini(const struct count_table *t, unsigned field, int value)
+{
+	int g = count_table_find_group(t, field, value);
+	if (g < 0)
+		return 0.0;
+
+	const int count = t->g[g].count;
+	double gini = 1.0;
+	for (int i=t->g[g].first; i>=0; i=t->link[i]) {
+		double f = (double)t->e[i].count / (double)count;
+		gini -= f * f;
+	}
+
+	return gini;
+}
+
+double
+count_table_gain(const struct count_table *t, unsigned field,
+				 enum count_criterion criterion)
+{
+	if (criterion == COUNT_ENTROPY)
+		return count_table_info_gain(t, field);
+
+	const int count = count_table_total(t);
+
+	double g = count_table_set_gini(t);
+
+	for (int i=0; i<t->ngroups; i++) {
+		if (t->g[i].field != field)
+			continue;
+
+		double n = (double)t->g[i].count / (double)count;
+		n *= count_table_gini(t, field, t->g[i].value);
+		g -= n;
+	}
+
+	return g;
+}
+
+double
+count_table_best_subset(const struct count_table *t, unsigned field,
+						enum count_criterion criterion,
+						int **left, int *nleft, int **right, int *nright)
+{
+	return count_table_split_subset(t, field, criterion, 0,
+									left, nleft, right, nright);
+}
+
+double
+count_table_split_subset(const struct count_table *t, unsigned field,
+						 enum count_criterion criterion,
+						 unsigned long long seed,
+						 int **left, int *nleft, int **right, int *nright)
+{
+	int nresults = 0;
+	int first = 0;
+	for (int i=0; i<t->ngroups; i++) {
+		if (t->g[i].field == SAMPLE_RESULT_FIELD && nresults++ == 0)
+			first = t->g[i].value;
+	}
+
+	int unique = 0;
+	for (int i=0; i<t->ngroups; i++) {
+		if (t->g[i].field == field)
+			unique++;
+	}
+
+	if (nresults != 2 || unique < 2)
+		return -1;
+
+	struct subset_value *vals;
+	vals = (struct subset_value*)malloc(sizeof(struct subset_value) * unique);
+	int total = 0;
+	int total_first = 0;
+	int n = 0;
+	for (int i=0; i<t->ngroups; i++) {
+		if (t->g[i].field != field)
+			continue;
+
+		int e = count_table_find(t, field, t->g[i].value, first);
+		vals[n].value = t->g[i].value;
+		vals[n].count = t->g[i].count;
+		vals[n].first = e >= 0 ? t->e[e].count : 0;
+		vals[n].order = n;
+		total += vals[n].count;
+		total_first += vals[n].first;
+		n++;
+	}
+
+	qsort(vals, unique, sizeof(struct subset_value), subset_value_cmp);
+
+	// For two results, the best partition is a prefix of the values
+	// ordered by the rate of the first result. A random split only
+	// scores the prefix drawn from the seed.
+	int cut = -1;
+	if (seed)
+		cut = (int)(count_mix(seed ^ field) % (unsigned)(unique - 1));
+
+	const bool gini = criterion == COUNT_GINI;
+	const double e = gini ? count_table_set_gini(t) : count_table_set_entropy(t);
+	double best = -1;
+	int best_size = 0;
+	int l = 0;
+	int l_first = 0;
+	for (int i=0; i<unique-1; i++) {
+		l += vals[i].count;
+		l_first += vals[i].first;
+		if (cut >= 0 && i != cut)
+			continue;
+
+		const int r = total - l;
+		const int r_first = total_first - l_first;
+		double gain = e;
+		if (gini) {
+			gain -= (double)l / total * gini2(l_first, l);
+			gain -= (double)r / total * gini2(r_first, r);
+		} else {
+			gain -= (double)l / total * entropy2(l_first, l);
+			gain -= (double)r / total * entropy2(r_first, r);
+		}
+
+		if (gain > best) {
+			best = gain;
+			best_size = i + 1;
+		}
+	}
+
+	if (left) {
+		*nleft = best_size;
+		*nright = unique - best_size;
+		*left = (int*)malloc(sizeof(int) * *nleft);
+		*right = (int*)malloc(sizeof(int) * *nright);
+
+		for (int i=0; i<unique; i++) {
+			if (i < best_size)
+				(*left)[i] = vals[i].value;
+			else
+				(*right)[i - best_size] = vals[i].value;
+		}
+
+		qsort(*left, *nleft, sizeof(int), int_cmp);
+		qsort(*right, *nright, sizeof(int), int_cmp);
+	}
+
+	free(vals);
+	return best;
+}
+
+int
+count_table_best_field(const struct count_table *t, const bool *excluded,
+					   int max_branch, enum count_criterion criterion,
+					   bool *subset)
+{
+	// Return the field with the highest impurity decrease which is not
+	// excluded
+	double bestval = -1000000;
+	int best = -1;
+	*subset = false;
+
+	for (int i=0; i<SAMPLE_NUM_FIELDS; i++) {
+		if (i == SAMPLE_RESULT_FIELD || excluded[i])
+			continue;
+
+		int unique = 0;
+		for (int j=0; j<t->ngroups; j++) {
+			if (t->g[j].field == (unsigned)i)
+				unique++;
+		}
+
+		bool sub = false;
+		double ig = -1;
+		if (unique > max_branch)
+			ig = count_table_best_subset(t, i, criterion, NULL, NULL, NULL, NULL);
+		if (ig >= 0)
+			sub = true;
+		else
+			ig = count_table_gain(t, i, criterion);
+
+		if (ig > bestval) {
+			bestval = ig;
+			best = i;
+			*subset = sub;
+		}
+	}
+
+	return best;
+}
+
+int
+count_table_random_field(const struct count_table *t, const bool *excluded,
+						 int max_branch, enum count_criterion criterion,
+						 int candidates, unsigned long long seed,
+						 bool *subset)
+{
+	int nresults = 0;
+	for (int j=0; j<t->ngroups; j++) {
+		if (t->g[j].field == SAMPLE_RESULT_FIELD)
+			nresults++;
+	}
+
+	// The fields that are not excluded and vary in the set
+	int fields[SAMPLE_NUM_FIELDS];
+	int unique[SAMPLE_NUM_FIELDS];
+	int n = 0;
+	for (int i=0; i<SAMPLE_NUM_FIELDS; i++) {
+		if (i == SAMPLE_RESULT_FIELD || excluded[i])
+			continue;
+
+		int u = 0;
+		for (int j=0; j<t->ngroups; j++) {
+			if (t->g[j].field == (unsigned)i)
+				u++;
+		}
+		if (u > 1) {
+			fields[n] = i;
+			unique[n] = u;
+			n++;
+		}
+	}
+
+	// Draw the candidates without replacement, and score them unless
+	// there is only one
+	if (candidates > n)
+		candidates = n;
+	double bestval = -1000000;
+	int best = -1;
+	*subset = false;
+
+	unsigned long long draw = seed;
+	for (int c=0; c<candidates; c++) {
+		draw = count_mix(draw);
+		const int k = c + (int)(draw % (unsigned)(n - c));
+		const int f = fields[k];
+		const int u = unique[k];
+		fields[k] = fields[c];
+		unique[k] = unique[c];
+		fields[c] = f;
+		unique[c] = u;
+
+		const bool sub = u > max_branch && nresults == 2;
+		double ig = 0;
+		if (candidates > 1 && sub)
+			ig = count_table_split_subset(t, f, criterion, seed,
+										  NULL, NULL, NULL, NULL);
+		else if (candidates > 1)
+			ig = count_table_gain(t, f, criterion);
+
+		if (best < 0 || ig > bestval) {
+			bestval = ig;
+			best = f;
+			*subset = sub;
+		}
+	}
+
+	return best;
+}
+
+int
+count_table_min_branch(const struct count_table *t, unsigned field,
+					   bool subset, enum count_criterion criterion,
+					   unsigned long long seed)
+{
+	if (subset) {
+		int *left = NULL;
+		int *right = NULL;
+		int nleft = 0;
+		int nright = 0;
+		count_table_split_subset(t, field, criterion, seed, &left, &nleft,
+								 &right, &nright);
+
+		int l = 0;
+		for (int i=0; i<nleft; i++)
+			l += count_table_value_count(t, field, left[i]);
+		const int r = count_table_total(t) - l;
+
+		free(left);
+		free(right);
+		return l < r ? l : r;
+	}
+
+	int min = -1;
+	for (int i=0; i<t->ngroups; i++) {
+		if (t->g[i].field == field && (min < 0 || t->g[i].count < min))
+			min = t->g[i].count;
+	}
+
+	return min;
+}
+
+int*
+count_table_values(const struct count_table *t, unsigned field,
+				   int *num_unique)
+{
+	int *vals = (int*)malloc(sizeof(int) * (t->ngroups + 1));
+	*num_unique = 0;
+
+	for (int i=0; i<t->ngroups; i++) {
+		if (t->g[i].field == field)
+			vals[(*num_unique)++] = t->g[i].value;
+	}
+
+	return vals;
+}
+
+int
+count_table_majority(const struct count_table *t)
+{
+	int val = -1;
+	int best = 0;
+
+	for (int i=0; i<t->ngroups; i++) {
+		if (t->g[i].field != SAMPLE_RESULT_FIELD)
+			continue;
+		if (t->g[i].count > best) {
+			val = t->g[i].value;
+			best = t->g[i].count;
+		}
+	}
+
+	return val;
+}
+
+
+unsigned long long
+count_table_hash(const struct count_table *t)
+{
+	unsigned long long h = 0;
+	for (int i=0; i<t->size; i++) {
+		const struct count_entry *e = &t->e[i];
+		h = count_mix(h ^ e->field);
+		h = count_mix(h ^ (unsigned)e->value);
+		h = count_mix(h ^ (unsigned)e->result);
+		h = count_mix(h ^ (unsigned)e->count);
+	}
+
+	return h;
+}
+
+unsigned long long
+count_table_seed(const struct count_table *t, unsigned long long seed)
+{
+	unsigned long long s = count_mix(count_table_hash(t) ^ count_mix(seed));
+	return s ? s : 1;
+}
+
+
+/** Hashing **/
+static int
+count_table_find(const struct count_table *t, unsigned field,
+				 int value, int result)
+{
+	if (!t->nslots)
+		return -1;
+
+	const unsigned mask = t->nslots - 1;
+	unsigned h = count_hash(field, value, result) & mask;
+	while (t->entry_slot[h]) {
+		const struct count_entry *e = &t->e[t->entry_slot[h] - 1];
+		if (e->field == field && e->value == value && e->result == result)
+			return t->entry_slot[h] - 1;
+		h = (h + 1) & mask;
+	}
+
+	return -1;
+}
+
+static int
+count_table_find_group(const struct count_table *t, unsigned field, int value)
+{
+	if (!t->nslots)
+		return -1;
+
+	const unsigned mask = t->nslots - 1;
+	unsigned h = count_hash(field, value, 0) & mask;
+	while (t->group_slot[h]) {
+		const struct count_group *g = &t->g[t->group_slot[h] - 1];
+		if (g->field == field && g->value == value)
+			return t->group_slot[h] - 1;
+		h = (h + 1) & mask;
+	}
+
+	return -1;
+}
+
+static void
+count_table_rehash(struct count_table *t, int nslots)
+{
+	t->nslots = nslots;
+	t->entry_slot = (int*)realloc(t->entry_slot, sizeof(int) * nslots);
+	t->group_slot = (int*)realloc(t->group_slot, sizeof(int) * nslots);
+	memset(t->entry_slot, 0, sizeof(int) * nslots);
+	memset(t->group_slot, 0, sizeof(int) * nslots);
+
+	const unsigned mask = nslots - 1;
+	for (int i=0; i<t->size; i++) {
+		const struct count_entry *e = &t->e[i];
+		unsigned h = count_hash(e->field, e->value, e->result) & mask;
+		while (t->entry_slot[h])
+			h = (h + 1) & mask;
+		t->entry_slot[h] = i + 1;
+	}
+
+	for (int i=0; i<t->ngroups; i++) {
+		const struct count_group *g = &t->g[i];
+		unsigned h = count_hash(g->field, g->value, 0) & mask;
+		while (t->group_slot[h])
+			h = (h + 1) & mask;
+		t->group_slot[h] = i + 1;
+	}
+}
+
+static unsigned
+count_hash(unsigned field, int value, int result)
+{
+	unsigned h = field * 0x9e3779b1u;
+	h ^= (unsigned)value + 0x7f4a7c15u + (h << 6) + (h >> 2);
+	h ^= (unsigned)result + 0x165667b1u + (h << 6) + (h >> 2);
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	return h;
+}
+
+
+/** Subset splits **/
+static int
+subset_value_cmp(const void *a, const void *b)
+{
+	const struct subset_value *x = (const struct subset_value*)a;
+	const struct subset_value *y = (const struct subset_value*)b;
+
+	// Compare first / count without division
+	long long l = (long long)x->first * y->count;
+	long long r = (long long)y->first * x->count;
+	if (l != r)
+		return l < r ? -1 : 1;
+	return x->order - y->order;
+}
+
+static double
+entropy2(int a, int n)
+{
+	double e = 0.0;
+	if (a > 0 && a < n) {
+		double f = (double)a / (double)n;
+		e -= f * log2(f);
+		e -= (1.0 - f) * log2(1.0 - f);
+	}
+	return e;
+}
+
+static double
+gini2(int a, int n)
+{
+	if (n == 0)
+		return 0.0;
+	double f = (double)a / (double)n;
+	return 1.0 - f * f - (1.0 - f) * (1.0 - f);
+}
+
+/* The finalizer of splitmix64 */
+static unsigned long long
+count_mix(unsigned long long x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
@@ -0,0 +1,174 @@
+#ifndef __COUNTS_H__
+#define __COUNTS_H__
+
+#include "sample.h"
+
+
+/* count_table
+ * The sufficient statistics of a sample set: the number of samples for each
+ * (field, value, result) combination. The result distribution of the set
+ * itself is stored under field SAMPLE_RESULT_FIELD.
+ *
+ * Tables are additive. Tables counted over disjoint shards can be merged
+ * into the table of the union, which is all the split search needs.
+ *
+ * Entries are kept in order of first appearance. Merging shards in order
+ * therefore yields the same entry order as counting the whole set, and
+ * ties are broken exactly as in dt_parse_samples.
+ *
+ * Entries with the same (field, value) form a group. Both entries and
+ * groups are hashed, so the cost of counting does not depend on the
+ * number of unique values.
+ */
+/* Impurity measure of the split search */
+enum count_criterion {
+	COUNT_ENTROPY,
+	COUNT_GINI,
+};
+
+struct count_entry {
+	unsigned field;
+	int value;
+	int result;
+	int count;
+};
+
+struct count_group {
+	unsigned field;
+	int value;
+	int count;
+	int first;		// First entry of the group, following "link"
+	int last;
+};
+
+struct count_table {
+	int size;
+	int cap;
+	struct count_entry *e;
+	int *link;		// Next entry of the same group, or -1
+
+	int ngroups;
+	int group_cap;
+	struct count_group *g;
+
+	// Open addressing over entries and groups, slots hold index+1
+	int nslots;
+	int *entry_slot;
+	int *group_slot;
+};
+
+void count_table_init(struct count_table*);
+void count_table_clear(struct count_table*);
+void count_table_free(struct count_table*);
+
+void count_table_add(struct count_table*, unsigned field, int value,
+					 int result, int count);
+void count_table_add_sample(struct count_table*, const struct sample*);
+void count_table_merge(struct count_table *dst, const struct count_table*);
+
+/* The number of samples counted in the table.
+ */
+int count_table_total(const struct count_table*);
+
+/* The number of samples where member[field] equals value.
+ */
+int count_table_value_count(const struct count_table*, unsigned field, int value);
+
+/* Entropy of the result field in the counted set, and in the subset
+ * where member[field] equals value.
+ */
+double count_table_set_entropy(const struct count_table*);
+double count_table_entropy(const struct count_table*, unsigned field, int value);
+
+/* Information gain if the counted set is divided on (field). Yields the
+ * same value as info_gain() on the samples the table was counted from.
+ */
+double count_table_info_gain(const struct count_table*, unsigned field);
+
+/* Gini impurity of the result field in the counted set, and in the
+ * subset where member[field] equals value.
+ */
+double count_table_set_gini(const struct count_table*);
+double count_table_gini(const struct count_table*, unsigned field, int value);
+
+/* Decrease of the impurity if the counted set is divided on (field).
+ * For COUNT_ENTROPY, this is count_table_info_gain().
+ */
+double count_table_gain(const struct count_table*, unsigned field,
+						enum count_criterion);
+
+/* Impurity decrease of the best division of the values of (field) in two
+ * subsets. The set must have exactly two results; the values are sorted
+ * by the rate of the first result, and the best split is one of the
+ * prefixes of that order. Unless "left" is NULL, the values of the prefix
+ * and the remaining values are assigned to "left" and "right" in
+ * ascending order, to be freed by the caller.
+ *
+ * Returns -1 if the set does not have two results, or the field fewer
+ * than two values.
+ */
+double count_table_best_subset(const struct count_table*, unsigned field,
+							   enum count_criterion,
+							   int **left, int *nleft,
+							   int **right, int *nright);
+
+/* As count_table_best_subset(), but a nonzero [seed] draws the prefix at
+ * random instead. The same seed and table always yield the same subsets.
+ */
+double count_table_split_subset(const struct count_table*, unsigned field,
+								enum count_criterion, unsigned long long seed,
+								int **left, int *nleft,
+								int **right, int *nright);
+
+/* The field with the highest impurity decrease among the fields that are
+ * not excluded, or -1 if there is none. Fields with more than [max_branch]
+ * values in a two-result set are scored by count_table_best_subset(), and
+ * "subset" tells whether the returned field is one of them.
+ */
+int count_table_best_field(const struct count_table*, const bool *excluded,
+						   int max_branch, enum count_criterion,
+						   bool *subset);
+
+/* Extremely randomized variant of count_table_best_field(). Draws up to
+ * [candidates] fields from [seed] among those not excluded that have two
+ * or more values, and returns the one with the highest impurity decrease,
+ * the subsets of a field being split at random as with
+ * count_table_split_subset() and the same seed. A single candidate is
+ * returned without computing any impurity. Returns -1 if no field varies.
+ */
+int count_table_random_field(const struct count_table*, const bool *excluded,
+							 int max_branch, enum count_criterion,
+							 int candidates, unsigned long long seed,
+							 bool *subset);
+
+/* The number of samples in the smallest branch of a split on (field):
+ * one branch per value or, with [subset], the two subsets chosen by
+ * count_table_split_subset() with [seed].
+ */
+int count_table_min_branch(const struct count_table*, unsigned field,
+						   bool subset, enum count_criterion,
+						   unsigned long long seed);
+
+/* The unique values of member[field] in order of first appearance. The
+ * return value has to be freed manually by the caller.
+ */
+int* count_table_values(const struct count_table*, unsigned field,
+						int *num_unique);
+
+/* The most common result value, or -1 for an empty table.
+ */
+int count_table_majority(const struct count_table*);
+
+/* A hash of the counted entries in order. Tables counted from the same
+ * set of samples hash alike, whichever trainer counted them.
+ */
+unsigned long long count_table_hash(const struct count_table*);
+
+/* The seed of the random splits of the counted set, mixed from the hash
+ * of the table and [seed]. Every bit of [seed] matters, and the result is
+ * never 0.
+ */
+unsigned long long count_table_seed(const struct count_table*,
+									unsigned long long seed);
+
+#endif /* __COUNTS_H__ */
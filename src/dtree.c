@@ -1,118 +1,365 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "dtree.h"
+#include "inspect.h"
+#include "counts.h"
+#include "cache.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
 
 
+/* The training set of a lazily trained tree. The samples of each pending
+ * node occupy a range of "rows", in the order dt_parse_samples() would
+ * have passed them to the subtree.
+ */
+struct dt_lazy {
+	struct sample *rows;
+	struct dt_params params;
+	struct decision *root;
+};
 
+struct dt_pending {
+	struct dt_lazy *lazy;
+	int row;
+	int count;
+	struct where *where;	// The where-clauses leading to the node
+	int depth;
+	pthread_mutex_t lock;
+};
+
+/* One level of growth below a pending node. Subtrees become pending nodes,
+ * and their samples are stored in order from "row".
+ */
+struct dt_grow {
+	struct dt_lazy *lazy;
+	int row;
+};
+
+static struct decision* dt_create_lazy(const struct sample*, int,
+									   const struct dt_params*);
+static struct decision* dt_pending_node(struct dt_grow*, const struct sample*,
+										int, struct where*, int depth);
+static void dt_grow_node(struct decision*);
+static void dt_pending_free(struct decision*);
 
-static struct decision* dt_alloc();
 static struct decision* dt_parse_samples(const struct sample*, int,
-										 struct where*);
+										 struct where*, int depth,
+										 const struct dt_params*,
+										 struct dt_grow*);
+static struct decision* dt_parse_child(const struct sample*, int,
+									   struct where*, int depth,
+									   const struct dt_params*,
+									   struct dt_grow*);
+static struct decision* dt_split_subset(const struct sample*, int,
+										struct where*, int depth,
+										const struct dt_params*,
+										struct dt_grow*,
+										const struct count_table*, int,
+										unsigned long long seed);
+static struct decision* dt_subset_chain(const struct count_table*, int field,
+										enum count_criterion,
+										unsigned long long seed);
 static void dt_append_next(struct decision *root, struct decision *next);
+static bool dt_save_chain(const struct decision*, FILE*);
+static struct decision* dt_load_chain(FILE*, struct decision *parent,
+									  int version, bool*);
 
-static int best_field_where(const struct sample*, int, struct where*);
+static int best_field_where(const struct count_table*, struct where*,
+							const struct dt_params*, bool *subset,
+							unsigned long long *seed);
 static bool is_set_ambiguous(const struct sample*, int);
 static void majority_result(const struct sample*, int, unsigned*field, int*val);
 static struct decision* majority_result_node(const struct sample*, int);
+static struct decision* majority_table_node(const struct count_table*);
 static void print_set_info(const struct sample*, int, struct where*);
 
 
-struct dt_deque {
-	int size;
-	int head;
-	int tail;
-	const struct decision **d;
-};
 
-static void print_path(const struct decision *leaf);
+void
+dt_params_default(struct dt_params *params)
+{
+	memset(params, 0, sizeof(struct dt_params));
+	params->max_branch = DT_MAX_BRANCH;
+	params->min_leaf = 1;
+	params->criterion = COUNT_ENTROPY;
+	params->cache_size = DT_CACHE_SIZE;
+	params->memory = DT_MEMORY;
+}
 
-static struct dt_deque* dt_deque_create();
-static void dt_deque_destroy(struct dt_deque*);
-static int dt_deque_size(struct dt_deque*);
-static void dt_deque_push(struct dt_deque*, const struct decision*);
-static const struct decision* dt_deque_pop_back(struct dt_deque*);
-static const struct decision* dt_deque_pop_front(struct dt_deque*);
+struct decision*
+dt_create(const struct sample *samples, int count)
+{
+	struct dt_params params;
+	dt_params_default(&params);
+	return dt_create_params(samples, count, &params);
+}
 
+struct decision*
+dt_create_params(const struct sample *samples, int count,
+				 const struct dt_params *params)
+{
+	if (!params->cache_dir && params->lazy)
+		return dt_create_lazy(samples, count, params);
+	if (!params->cache_dir)
+		return dt_parse_samples(samples, count, NULL, 0, params, NULL);
+
+	// Concurrent processes training the same model wait for the first
+	// one to store it, and load it from the cache instead.
+	const unsigned long long key = dt_cache_key(samples, count, params);
+	int lock = dt_cache_lock(params->cache_dir, key);
+
+	struct decision *dec = dt_cache_load(params->cache_dir, key);
+	if (!dec) {
+		dec = dt_parse_samples(samples, count, NULL, 0, params, NULL);
+		if (dec && !dt_cache_store(params->cache_dir, key, dec,
+								   params->cache_size))
+			printf("WARNING: unable to store the model in %s\n",
+				   params->cache_dir);
+	}
 
+	dt_cache_unlock(lock);
+	return dec;
+}
 
 struct decision*
-dt_create(const struct sample *samples, int count)
+dt_create_subtree(const struct sample *samples, int count, struct where *where,
+				  int depth, const struct dt_params *params)
+{
+	return dt_parse_samples(samples, count, where, depth, params, NULL);
+}
+
+int
+dt_split_field(const struct count_table *t, const bool *excluded,
+			   const struct dt_params *params, bool *subset,
+			   unsigned long long *seed)
+{
+	*seed = 0;
+	if (params->extra <= 0)
+		return count_table_best_field(t, excluded, params->max_branch,
+									  params->criterion, subset);
+
+	// Never zero, which would select the best subsets
+	*seed = count_table_seed(t, params->seed);
+	return count_table_random_field(t, excluded, params->max_branch,
+									params->criterion, params->extra,
+									*seed, subset);
+}
+
+bool
+dt_split_allowed(const struct count_table *t, int field, bool subset,
+				 unsigned long long seed, int depth,
+				 const struct dt_params *params)
+{
+	if (params->max_depth > 0 && depth >= params->max_depth)
+		return false;
+	if (params->min_leaf <= 1)
+		return true;
+	return count_table_min_branch(t, field, subset, params->criterion, seed)
+		   >= params->min_leaf;
+}
+
+struct decision*
+dt_split_node(const struct count_table *t, const bool *excluded, int depth,
+			  const struct dt_params *params, int *nchild)
 {
-	return dt_parse_samples(samples, count, NULL);
+	int nresults = 0;
+	free(count_table_values(t, SAMPLE_RESULT_FIELD, &nresults));
+
+	bool subset = false;
+	unsigned long long seed = 0;
+	int best = -1;
+	if (nresults > 1)
+		best = dt_split_field(t, excluded, params, &subset, &seed);
+	if (best >= 0 && !dt_split_allowed(t, best, subset, seed, depth, params))
+		best = -1;
+
+	*nchild = 0;
+	if (best >= 0 && subset) {
+		*nchild = 2;
+		return dt_subset_chain(t, best, params->criterion, seed);
+	}
+
+	int unique = 0;
+	int *vals = NULL;
+	if (best >= 0)
+		vals = count_table_values(t, best, &unique);
+
+	if (unique < 2) {
+		free(vals);
+		return majority_table_node(t);
+	}
+
+	struct decision *dec = NULL;
+	struct decision **slot = &dec;
+	for (int i=0; i<unique; i++) {
+		*slot = dt_alloc();
+		(*slot)->field = best;
+		(*slot)->value = vals[i];
+		slot = &(*slot)->next;
+	}
+
+	free(vals);
+	*nchild = unique;
+	return dec;
+}
+
+int*
+dt_split_pairs(const struct decision *dec, int *npairs)
+{
+	int n = 0;
+	for (const struct decision *d = dec; d; d=d->next)
+		n += d->set ? d->set_size : 1;
+
+	int *pairs = (int*)malloc(sizeof(int) * 2 * (n + 1));
+	int c = 0;
+	int k = 0;
+	for (const struct decision *d = dec; d; d=d->next, c++) {
+		for (int i=0; i<(d->set ? d->set_size : 1); i++) {
+			pairs[2*k] = d->set ? d->set[i] : d->value;
+			pairs[2*k+1] = c;
+			k++;
+		}
+	}
+
+	qsort(pairs, n, sizeof(int) * 2, int_cmp);
+	*npairs = n;
+	return pairs;
+}
+
+int
+dt_pair_find(const int *pairs, int npairs, int value)
+{
+	const int *p = (const int*)bsearch(&value, pairs, npairs, sizeof(int) * 2,
+									   int_cmp);
+	return p ? p[1] : -1;
 }
 
 int 
 dt_decide(const struct decision *dec, const struct sample *sample)
 {
 	while (dec && dec->dest) {
-		while (dec && dec->value != field_value(sample, dec->field)) 
+		while (dec && !dt_match(dec, field_value(sample, dec->field)))
 			dec = dec->next;
 		if (!dec) 
 			return -1;
 		dec = dec->dest;
+		dt_expand((struct decision*)dec);
 	}
 
 	return dec->value;
 }
 
+void
+dt_decide_batch(const struct decision *dec, const struct sample *samples,
+				int count, int *out)
+{
+	for (int i=0; i<count; i++)
+		out[i] = dt_decide(dec, &samples[i]);
+}
+
 void 
 dt_destroy(struct decision *dec)
 {
+	if (dec->flags & DT_FLAT) {
+		free(dec);
+		return;
+	}
+
+	free(dec->set);
 	if (dec->dest != NULL) 
 		dt_destroy(dec->dest);
 	if (dec->next != NULL) 
 		dt_destroy(dec->next);
 
+	// The root is released last, along with the training set
+	if (dec->pending)
+		dt_pending_free(dec);
 	free(dec);
 }
 
+void
+dt_grow(struct decision *dec)
+{
+	for (; dec; dec=dec->next) {
+		dt_expand(dec);
+		dt_grow(dec->dest);
+	}
+}
+
+void
+dt_expand(struct decision *dec)
+{
+	if (__atomic_load_n(&dec->flags, __ATOMIC_ACQUIRE) & DT_PENDING)
+		dt_grow_node(dec);
+}
+
+bool
+dt_save(const struct decision *dec, FILE *file)
+{
+	fprintf(file, "dtree 3\n");
+	return dt_save_chain(dec, file) && !ferror(file);
+}
+
+struct decision*
+dt_load(FILE *file)
+{
+	int version = 0;
+	if (fscanf(file, "dtree %i", &version) != 1 || version < 1 || version > 3)
+		return NULL;
+
+	bool ok = true;
+	struct decision *dec = dt_load_chain(file, NULL, version, &ok);
+	if (!ok && dec) {
+		dt_destroy(dec);
+		dec = NULL;
+	}
+
+	return dec;
+}
+
+bool
+dt_equal(const struct decision *a, const struct decision *b)
+{
+	for (; a && b; a=a->next, b=b->next) {
+		if (a->field != b->field || a->value != b->value ||
+			a->samples != b->samples || a->agree != b->agree ||
+			a->set_size != b->set_size || !a->set != !b->set)
+			return false;
+		if (a->set && memcmp(a->set, b->set, sizeof(int) * a->set_size))
+			return false;
+		if (!dt_equal(a->dest, b->dest))
+			return false;
+	}
+
+	return !a && !b;
+}
+
 void 
 dt_assert_valid(struct decision *dec)
 {
-	bool error = false;
-	const struct decision *d = dec;
-	struct dt_deque *dq = dt_deque_create();
-	dt_deque_push(dq, d);
+	struct dt_stats stats;
 
 	printf("[ASSERTING VALIDITY OF DECISION TREE]\n");
 
-	while (dt_deque_size(dq)) {
-		d = dt_deque_pop_front(dq);
-		if (d->dest) {
-			dt_deque_push(dq, d->dest);
-
-			// Assert parent relationships
-			struct decision *c = d->dest;
-			while (c) {
-				if (c->parent != d) {
-					printf("\t[ERROR]: Child node does not recognize parent\n");
-					error = true;
-				}
-				c = c->next;
-			}
-		}
-		
-		// Assert field-equality
-		while (d->next) {
-			if (d->field != d->next->field) {
-				printf("\t[ERROR]: Invalid tree! One node contains multiple\n"
-						"\tdefinitions for more than one field\n");
-				error = true;
-			}
-			d = d->next;
-		}
-	}
-
-	if (!error)
+	if (dt_validate(dec, &stats)) {
 		printf("\tNo errors found\n");
-	else
+	} else {
+		if (stats.parent_errors)
+			printf("\t[ERROR]: %li child nodes do not recognize their parent\n",
+					stats.parent_errors);
+		if (stats.field_errors)
+			printf("\t[ERROR]: Invalid tree! %li nodes contain definitions\n"
+					"\tfor another field than their siblings\n",
+					stats.field_errors);
 		printf("\tErrors occurred. The tree's judgement is impaired.\n");
+	}
 
-	dt_deque_destroy(dq);
+	dt_stats_print(&stats, stdout);
 }
 
-static struct decision*
+struct decision*
 dt_alloc()
 {
 	struct decision *dec = (struct decision*)malloc(sizeof(struct decision));
@@ -120,20 +367,170 @@ dt_alloc()
 	return dec;
 }
 
+
+/** Lazy growth **/
 static struct decision*
-dt_parse_samples(const struct sample *samples, int max, struct where *where)
+dt_create_lazy(const struct sample *samples, int count,
+			   const struct dt_params *params)
 {
+	struct dt_lazy *lazy = (struct dt_lazy*)malloc(sizeof(struct dt_lazy));
+	lazy->rows = (struct sample*)malloc(sizeof(struct sample) * count);
+	lazy->params = *params;
+
+	struct dt_grow grow = { lazy, 0 };
+	lazy->root = dt_pending_node(&grow, samples, count, NULL, 0);
+	dt_grow_node(lazy->root);
+	return lazy->root;
+}
+
+/* A node standing in for the subtree of [samples] until it is grown.
+ */
+static struct decision*
+dt_pending_node(struct dt_grow *grow, const struct sample *samples, int count,
+				struct where *where, int depth)
+{
+	struct dt_pending *p = (struct dt_pending*)malloc(sizeof(struct dt_pending));
+	p->lazy = grow->lazy;
+	p->row = grow->row;
+	p->count = count;
+	p->where = NULL;
+	p->depth = depth;
+	pthread_mutex_init(&p->lock, NULL);
+
+	for (; where; where=where->next) {
+		struct where *w = where_alloc();
+		w->field = where->field;
+		w->value = where->value;
+		if (p->where)	where_append(p->where, w);
+		else			p->where = w;
+	}
+
+	memcpy(grow->lazy->rows + grow->row, samples, sizeof(struct sample) * count);
+	grow->row += count;
+
+	struct decision *d = dt_alloc();
+	d->flags = DT_PENDING;
+	d->pending = p;
+	return d;
+}
+
+/* Grow one level below the pending node [d]. The level is trained into
+ * a new chain, which is then moved into [d] so that the references to
+ * [d] stay valid. Deciders only follow [d] once DT_PENDING is cleared.
+ */
+static void
+dt_grow_node(struct decision *d)
+{
+	struct dt_pending *p = d->pending;
+	pthread_mutex_lock(&p->lock);
+	if (!(d->flags & DT_PENDING)) {
+		pthread_mutex_unlock(&p->lock);
+		return;
+	}
+
+	// Subtrees are stored over the range of the node, so train on a copy
+	struct dt_lazy *lazy = p->lazy;
+	const size_t sz = sizeof(struct sample) * p->count;
+	struct sample *samples = (struct sample*)malloc(sz);
+	memcpy(samples, lazy->rows + p->row, sz);
+
+	struct dt_grow grow = { lazy, p->row };
+	struct decision *head;
+	head = dt_parse_samples(samples, p->count, p->where, p->depth,
+							&lazy->params, &grow);
+	free(samples);
+
+	d->field = head->field;
+	d->value = head->value;
+	d->set = head->set;
+	d->set_size = head->set_size;
+	d->next = head->next;
+	d->dest = head->dest;
+	d->samples = head->samples;
+	d->agree = head->agree;
+	free(head);
+
+	for (struct decision *n = d; n; n=n->next) {
+		n->parent = d->parent;
+		for (struct decision *sub = n->dest; sub; sub=sub->next)
+			sub->parent = d;
+	}
+
+	if (p->where) {
+		where_destroy(p->where);
+		p->where = NULL;
+	}
+
+	__atomic_store_n(&d->flags, d->flags & ~DT_PENDING, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&p->lock);
+}
+
+static void
+dt_pending_free(struct decision *d)
+{
+	struct dt_pending *p = d->pending;
+	struct dt_lazy *lazy = p->lazy;
+
+	if (p->where)
+		where_destroy(p->where);
+	pthread_mutex_destroy(&p->lock);
+	free(p);
+
+	if (lazy->root == d) {
+		free(lazy->rows);
+		free(lazy);
+	}
+}
+
+
+/** Training **/
+static struct decision*
+dt_parse_samples(const struct sample *samples, int max, struct where *where,
+				 int depth, const struct dt_params *params,
+				 struct dt_grow *grow)
+{
+	struct count_table t;
+	count_table_init(&t);
+	for (int i=0; i<max; i++)
+		count_table_add_sample(&t, &samples[i]);
+
 	bool ambiguous = is_set_ambiguous(samples, max);
-	int best_field = best_field_where(samples, max, where);
+	bool subset = false;
+	unsigned long long seed = 0;
+	int best_field = best_field_where(&t, where, params, &subset, &seed);
+
+	bool limited = false;
+	if (best_field >= 0 && ambiguous &&
+		!dt_split_allowed(&t, best_field, subset, seed, depth, params)) {
+		limited = true;
+		best_field = -1;
+	}
+
+	if (best_field >= 0 && ambiguous && subset) {
+		struct decision *dec;
+		dec = dt_split_subset(samples, max, where, depth, params, grow, &t,
+							  best_field, seed);
+		count_table_free(&t);
+		return dec;
+	}
+	count_table_free(&t);
+
+	// Lazy growth runs on the threads of the deciders, and does not log
+	const bool log = !grow;
 
 	if (best_field < 0 || !ambiguous)  {
+		struct decision *d = majority_result_node(samples, max);
+		if (!log)
+			return d;
+
 		if (!ambiguous) 
 			printf("Non-ambiguous set:\n");
+		else if (limited)
+			printf("Split limit reached:\n");
 		else
 			printf("No best field:\n");
 		print_set_info(samples, max, where);
 		
-		struct decision *d = majority_result_node(samples, max);
 		printf("\tLeaf with majority value %i -> %i\n", d->field, d->value);
 		return d;
 	}
@@ -163,12 +560,14 @@ dt_parse_samples(const struct sample *samples, int max, struct where *where)
 		// If the filtered subset is equal to the superset, the training
 		// data is ambiguous. Return a leaf node with the majority result
 		if (wmax == max) {
-			printf("Ambiguity in training set:\n\t");
-			print_set_info(samples, max, where);
 			dec = majority_result_node(samples, max);		
-
-			printf("\tassigning majority value %i=%i\n\n",
-					dec->field, dec->value);
+			if (log) {
+				printf("Ambiguity in training set:\n\t");
+				print_set_info(samples, max, where);
+				printf("\tassigning majority value %i=%i\n\n",
+						dec->field, dec->value);
+			}
+			free(wsamples);
 			goto dt_parse_samples_cleanup;
 		}
 
@@ -182,7 +581,8 @@ dt_parse_samples(const struct sample *samples, int max, struct where *where)
 		else 		dt_append_next(dec, d);
 
 		// Create a subtree
-		struct decision *sub = dt_parse_samples(wsamples, wmax, where);
+		struct decision *sub = dt_parse_child(wsamples, wmax, where, depth+1,
+											  params, grow);
 		d->dest = sub;
 
 		// Reference "dec" from all sibling nodes of sub
@@ -203,6 +603,76 @@ dt_parse_samples_cleanup:
 	return dec;
 }
 
+/* The subtree of a branch. When growing one level of a lazy tree, the
+ * subtree is left pending instead.
+ */
+static struct decision*
+dt_parse_child(const struct sample *samples, int max, struct where *where,
+			   int depth, const struct dt_params *params, struct dt_grow *grow)
+{
+	if (grow)
+		return dt_pending_node(grow, samples, max, where, depth);
+	return dt_parse_samples(samples, max, where, depth, params, NULL);
+}
+
+/* Split the set in the two subsets of values of [field] with the highest
+ * information gain, or drawn from [seed]. The field remains available
+ * further down the tree.
+ */
+static struct decision*
+dt_split_subset(const struct sample *samples, int max, struct where *where,
+				int depth, const struct dt_params *params, struct dt_grow *grow,
+				const struct count_table *t, int field, unsigned long long seed)
+{
+	struct decision *dec = dt_subset_chain(t, field, params->criterion, seed);
+
+	struct sample *in = (struct sample*)malloc(sizeof(struct sample) * max);
+	struct sample *out = (struct sample*)malloc(sizeof(struct sample) * max);
+	int nin = 0;
+	int nout = 0;
+	for (int i=0; i<max; i++) {
+		if (dt_match(dec, field_value(&samples[i], field)))
+			in[nin++] = samples[i];
+		else
+			out[nout++] = samples[i];
+	}
+
+	for (struct decision *d = dec; d; d=d->next) {
+		if (d == dec)
+			d->dest = dt_parse_child(in, nin, where, depth+1, params, grow);
+		else
+			d->dest = dt_parse_child(out, nout, where, depth+1, params, grow);
+
+		for (struct decision *sub = d->dest; sub; sub=sub->next)
+			sub->parent = dec;
+	}
+
+	free(in);
+	free(out);
+	return dec;
+}
+
+/* The two branches splitting the counted set in the subsets of values of
+ * [field] chosen by count_table_split_subset().
+ */
+static struct decision*
+dt_subset_chain(const struct count_table *t, int field,
+				enum count_criterion criterion, unsigned long long seed)
+{
+	struct decision *dec = dt_alloc();
+	dec->next = dt_alloc();
+	count_table_split_subset(t, field, criterion, seed,
+							 &dec->set, &dec->set_size,
+							 &dec->next->set, &dec->next->set_size);
+
+	for (struct decision *d = dec; d; d=d->next) {
+		d->field = field;
+		d->value = d->set[0];
+	}
+
+	return dec;
+}
+
 static void 
 dt_append_next(struct decision *root, struct decision *next)
 {
@@ -213,26 +683,17 @@ dt_append_next(struct decision *root, struct decision *next)
 
 
 static int
-best_field_where(const struct sample *samples, int count, struct where *where)
+best_field_where(const struct count_table *t, struct where *where,
+				 const struct dt_params *params, bool *subset,
+				 unsigned long long *seed)
 {
 	// Return the field with the highest information gain value which is 
 	// not mentioned by any where-clause
-	double bestval = -1000000;
-	int best = -1;
+	bool excluded[SAMPLE_NUM_FIELDS];
+	for (int i=0; i<SAMPLE_NUM_FIELDS; i++)
+		excluded[i] = is_field_clausule(where, i);
 
-	for (int i=0; i<SAMPLE_NUM_FIELDS; i++) {
-		if (i == SAMPLE_RESULT_FIELD)
-			continue;
-		if (!is_field_clausule(where, i)) {
-			double ig = info_gain(samples, count, i);
-			if (ig > bestval) {
-				bestval = ig;
-				best = i;
-			}
-		}
-	}
-
-	return best;
+	return dt_split_field(t, excluded, params, subset, seed);
 }
 
 static bool
@@ -281,6 +742,22 @@ majority_result_node(const struct sample *samples, int count)
 	struct decision *d = dt_alloc();
 	d->field = field;
 	d->value = val;
+	d->samples = count;
+	d->agree = value_count(samples, count, val, SAMPLE_RESULT_FIELD);
+	return d;
+}
+
+/* The leaf of a counted set, as majority_result_node() would build it
+ * from the samples.
+ */
+static struct decision*
+majority_table_node(const struct count_table *t)
+{
+	struct decision *d = dt_alloc();
+	d->field = SAMPLE_RESULT_FIELD;
+	d->value = count_table_majority(t);
+	d->samples = count_table_total(t);
+	d->agree = count_table_value_count(t, SAMPLE_RESULT_FIELD, d->value);
 	return d;
 }
 
@@ -296,115 +773,81 @@ print_set_info(const struct sample *samples, int count, struct where *where)
 }
 
 
-
-/** Printing of Decision Tree **/
-void
-print_decision_tree(const struct decision *d, FILE *file) 
+/* A node is stored as "field value has_dest has_next samples agree
+ * set_size set...", followed by the nodes of its dest chain. Version 1
+ * files lack the sample counts, version 2 files the sets.
+ */
+static bool
+dt_save_chain(const struct decision *d, FILE *file)
 {
-	printf("[DECISION TREE]\n");
-	printf("ALL paths from the root node to the leaf nodes are printed.\n");
-	printf("Each line represents one path. Each bracket represents one node.\n\n");
-	
-	struct dt_deque *dq = dt_deque_create();
-	dt_deque_push(dq, d);
-
-	// Iterate over all nodes, print path from leaves to root
-	while (dt_deque_size(dq) > 0) {
-		d = dt_deque_pop_back(dq);
-		
-		// Push dest on stack if exists, otherwise print
-		if (d->dest)
-			dt_deque_push(dq, d->dest);
-		else 
-			print_path(d);
-		// Push siblings on stack
-		for (struct decision *n = d->next; n; n=n->next) 
-			dt_deque_push(dq, n);
+	for (; d; d=d->next) {
+		fprintf(file, "%u %i %i %i %i %i ", d->field, d->value,
+				d->dest != NULL, d->next != NULL, d->samples, d->agree);
+		fprintf(file, "%i", d->set_size);
+		for (int i=0; i<d->set_size; i++)
+			fprintf(file, " %i", d->set[i]);
+		fprintf(file, "\n");
+		if (d->dest && !dt_save_chain(d->dest, file))
+			return false;
 	}
 
-
-	dt_deque_destroy(dq);
+	return true;
 }
 
-static void 
-print_path(const struct decision *leaf)
+static struct decision*
+dt_load_chain(FILE *file, struct decision *parent, int version, bool *ok)
 {
-	struct dt_deque *dq = dt_deque_create();
+	struct decision *head = NULL;
+	struct decision *prev = NULL;
+	int next = 1;
+
+	while (next && *ok) {
+		unsigned field;
+		int value, dest;
+		if (fscanf(file, "%u %i %i %i", &field, &value, &dest, &next) != 4) {
+			*ok = false;
+			break;
+		}
 
-	const struct decision *d = leaf;
-	dt_deque_push(dq, d);
-	d = d->parent;
+		struct decision *d = dt_alloc();
+		d->field = field;
+		d->value = value;
+		d->parent = parent;
+
+		if (version >= 2 &&
+			fscanf(file, "%i %i", &d->samples, &d->agree) != 2)
+			*ok = false;
+
+		if (version >= 3 && *ok) {
+			if (fscanf(file, "%i", &d->set_size) != 1 || d->set_size < 0)
+				*ok = false;
+			if (*ok && d->set_size > 0)
+				d->set = (int*)malloc(sizeof(int) * d->set_size);
+			for (int i=0; *ok && i<d->set_size; i++) {
+				if (fscanf(file, "%i", &d->set[i]) != 1)
+					*ok = false;
+			}
+		}
 
-	while (d) {
-		dt_deque_push(dq, d);
-		d = d->parent;
-	}
+		if (!head)	head = d;
+		else		prev->next = d;
+		prev = d;
 
-	// Print them in reverse order
-	while (dt_deque_size(dq) > 0) {
-		d = dt_deque_pop_back(dq);
-		printf("{%i => %i}", d->field, d->value);
+		if (dest)
+			d->dest = dt_load_chain(file, head, version, ok);
 	}
 
-	printf("\n");
-
-	dt_deque_destroy(dq);
-}
-
-
-/** dt_deque **/
-static struct dt_deque*
-dt_deque_create()
-{
-	struct dt_deque *s = (struct dt_deque*)malloc(sizeof(struct dt_deque));
-	memset(s, 0, sizeof(struct dt_deque));
-	return s;
-}
-
-static void 
-dt_deque_destroy(struct dt_deque *s)
-{
-	free(s->d);
-	free(s);
-}
-
-static int
-dt_deque_size(struct dt_deque *s)
-{
-	return s->tail - s->head;
+	return head;
 }
 
-static void
-dt_deque_push(struct dt_deque *s, const struct decision *d)
-{
-	if (s->d == NULL) {
-		s->size = 4;
-		s->tail = 0;
-		int sz = s->size * sizeof(struct decision*);
-		s->d = (const struct decision**)malloc(sz);
-	}
 
-	if (s->tail == s->size) {
-		s->size *= 2;
-		int sz = sizeof(struct decision*) * s->size;
-		s->d = (const struct decision**)realloc(s->d, sz);
-	}
-
-	s->d[s->tail++] = d;
-}	
-
-static const struct decision*
-dt_deque_pop_back(struct dt_deque *s)
+/** Printing of Decision Tree **/
+void
+print_decision_tree(const struct decision *d, FILE *file) 
 {
-	if (s->tail == s->head)
-		return NULL;
-	return s->d[--s->tail];
-}
+	fprintf(file, "[DECISION TREE]\n");
+	fprintf(file, "ALL paths from the root node to the leaf nodes are printed.\n");
+	fprintf(file, "Each line represents one path. Each bracket represents one node.\n\n");
 
-static const struct decision*
-dt_deque_pop_front(struct dt_deque *s)
-{
-	if (s->head == s->tail)
-		return NULL;
-	return s->d[s->head++];
+	dt_export(d, file, DT_FORMAT_PATH);
 }
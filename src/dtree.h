@@ -2,10 +2,12 @@
 #define __DTREE_H__
 
 #include "sample.h"
+#include "counts.h"
 #include <stdio.h>
 
 struct decision;
 struct dtree;
+struct dt_pending;
 
 
 /* decision
@@ -13,21 +15,209 @@ struct dtree;
  * If the value is equal, follow "dest" - otherwise follow "next". 
  *
  * If "dest" is NULL, the final decision can be found in "value".
+ *
+ * Fields with many values are split in two subsets instead of one branch
+ * per value. Such nodes hold the sorted values of their subset in "set",
+ * and are followed if the value is in the set.
  */
 struct decision {
 	unsigned field;
 	int value;
+	int *set;
+	int set_size;
 	struct decision *next;
 	struct decision *dest;
 	struct decision *parent;
+
+	// Training samples reaching a leaf, and those agreeing with its value
+	int samples;
+	int agree;
+
+	unsigned long hits;		// Visits recorded by dt_decide_profile()
+	unsigned flags;
+
+	struct dt_pending *pending;	// Growth state of lazily trained nodes
 };
 
+// The node is the first of a single allocation holding the entire tree
+#define DT_FLAT		1
+
+// The subtree of the node is not grown yet (see dt_params.lazy)
+#define DT_PENDING	2
+
+// Fields with more unique values in a set are split in two subsets
+#define DT_MAX_BRANCH	16
+
+// Default limit of the model cache, in bytes
+#define DT_CACHE_SIZE	(64L << 20)
+
+// Default memory budget of out-of-core training, in bytes
+#define DT_MEMORY		(256L << 20)
+
+/* Whether the node is followed for the given value.
+ */
+static inline bool
+dt_match(const struct decision *d, int value)
+{
+	if (!d->set)
+		return d->value == value;
+
+	int lo = 0;
+	int hi = d->set_size;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (d->set[mid] < value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo < d->set_size && d->set[lo] == value;
+}
+
 
 
+/* dt_params
+ * Training configuration. dt_params_default() assigns the configuration
+ * used by dt_create().
+ *
+ * A node at depth "max_depth" (the root chain being at depth 0) becomes a
+ * leaf, unless "max_depth" is 0. So does a node whose best split has a
+ * branch of fewer than "min_leaf" samples. Splits are scored by the
+ * decrease of "criterion".
+ *
+ * If "extra" is set, the nodes are split as in extremely randomized
+ * trees: "extra" candidate fields are drawn at random, subsets of values
+ * are cut at random, and only the candidates are scored. With one
+ * candidate, no impurity is computed at all, as suits ensembles (see
+ * src/forest.h). The draws of a node depend on "seed" and the samples of
+ * the node alone, so every trainer grows the same tree from a seed.
+ *
+ * If "cache_dir" is set, trained models are stored in that directory,
+ * addressed by a hash of the samples and the configuration. Training the
+ * same model again loads it from the cache. The cache holds at most
+ * "cache_size" bytes of models, evicting the least recently used.
+ *
+ * If "lazy" is set and there is no cache, only the root level is trained
+ * up front. The other subtrees are pending until dt_decide() first
+ * reaches them, and are then grown under a lock of their own, so that
+ * concurrent deciders may share the tree. The grown tree equals the one
+ * trained eagerly, but no training log is printed for it.
+ *
+ * The remaining fields configure out-of-core training (see src/spill.h).
+ * A NULL "spill_dir" puts the spill files in $TMPDIR or /tmp.
+ */
+struct dt_params {
+	int max_branch;
+	int max_depth;
+	int min_leaf;
+	enum count_criterion criterion;
+	int extra;
+	unsigned long seed;
+
+	const char *cache_dir;
+	long cache_size;
+	bool lazy;
+
+	const char *spill_dir;
+	long memory;
+	bool compress;
+};
+
+void dt_params_default(struct dt_params*);
+
 struct decision* dt_create(const struct sample*, int count);
+struct decision* dt_create_params(const struct sample*, int count,
+								  const struct dt_params*);
+
+/* Train the subtree of the samples selected by [where], as dt_create()
+ * would below the where-clauses at [depth]. The fields of the clauses are
+ * not split on again, and the caller assigns the parent of the returned
+ * chain.
+ */
+struct decision* dt_create_subtree(const struct sample*, int count,
+								   struct where*, int depth,
+								   const struct dt_params*);
+
+/* The field the configuration splits the counted set on, among those not
+ * excluded, or -1. "seed" is assigned the seed of the random subsets of
+ * the node (see count_table_split_subset()), which is 0 unless "extra"
+ * is set.
+ */
+int dt_split_field(const struct count_table*, const bool *excluded,
+				   const struct dt_params*, bool *subset,
+				   unsigned long long *seed);
+
+/* Whether the configuration allows a node at [depth] to split the counted
+ * set on (field), as chosen by dt_split_field().
+ */
+bool dt_split_allowed(const struct count_table*, int field, bool subset,
+					  unsigned long long seed, int depth,
+					  const struct dt_params*);
+
+/* The chain dt_create_params() trains for a node of the counted set at
+ * [depth], the excluded fields being used on the path: one branch per
+ * value of the split field, two branches holding subsets of its values,
+ * or a leaf with the majority result. The branches have no subtrees, and
+ * the caller assigns the parents. "nchild" is assigned the number of
+ * branches, or 0 for a leaf.
+ *
+ * The trainers growing trees one level at a time count each node into a
+ * table and split it with this, so they train the same trees.
+ */
+struct decision* dt_split_node(const struct count_table*, const bool *excluded,
+							   int depth, const struct dt_params*,
+							   int *nchild);
+
+/* The (value, branch) pairs of a chain of branches, the branches being
+ * numbered from 0 along the chain. The pairs are sorted by value, and
+ * returned in an array to be freed by the caller.
+ */
+int* dt_split_pairs(const struct decision*, int *npairs);
+
+/* The branch of [value] in pairs sorted by value, or -1.
+ */
+int dt_pair_find(const int *pairs, int npairs, int value);
+
+/* The decision of the tree for a sample, or -1 if no branch matches.
+ *
+ * Although the tree is const, deciding on a lazily trained tree grows the
+ * pending nodes it reaches, in place. Each node is grown under a lock of
+ * its own, so concurrent deciders may share a tree; it must not be
+ * destroyed, saved or otherwise walked meanwhile. Lazy growth does not
+ * print the training log.
+ */
 int dt_decide(const struct decision*, const struct sample*);
+
+// Decide [count] samples, writing the decisions to "out"
+void dt_decide_batch(const struct decision*, const struct sample*, int count,
+					 int *out);
 void dt_destroy(struct decision*);
 
+/* Grow all pending subtrees of a lazily trained tree. Saving, exporting,
+ * validating and laying out a tree expect it to be fully grown.
+ */
+void dt_grow(struct decision*);
+
+/* Grow the node reached by a decision if its subtree is pending. Every
+ * decide path calls it on each node it descends to.
+ */
+void dt_expand(struct decision*);
+
+// Allocate a zeroed node, to be released by dt_destroy()
+struct decision* dt_alloc();
+
+/* Write the tree to a file in preorder, and read it back. dt_load()
+ * returns NULL if the file does not hold a valid tree.
+ */
+bool dt_save(const struct decision*, FILE*);
+struct decision* dt_load(FILE*);
+
+/* Whether two fully grown trees hold the same nodes, subsets and training
+ * counts, in the same order.
+ */
+bool dt_equal(const struct decision*, const struct decision*);
+
 // Ensure that all nodes has the same value
 void dt_assert_valid(struct decision *);
 
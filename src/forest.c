@@ -0,0 +1,88 @@
+#include "forest.h"
+#include "multi.h"
+#include <stdlib.h>
+
+
+
+struct dt_forest*
+dt_forest_create(const struct sample *samples, int count,
+				 const struct dt_params *params, int ntrees, int threads)
+{
+	if (ntrees < 1) {
+		printf("ERROR: a forest needs at least one tree\n");
+		return NULL;
+	}
+
+	struct dt_params *p;
+	p = (struct dt_params*)malloc(sizeof(struct dt_params) * ntrees);
+	struct dt_target *targets;
+	targets = (struct dt_target*)malloc(sizeof(struct dt_target) * ntrees);
+	for (int i=0; i<ntrees; i++) {
+		p[i] = *params;
+		p[i].seed = params->seed + i;
+		if (p[i].extra <= 0)
+			p[i].extra = 1;
+		targets[i].labels = NULL;
+		targets[i].params = &p[i];
+	}
+
+	struct dt_forest *forest;
+	forest = (struct dt_forest*)malloc(sizeof(struct dt_forest));
+	forest->trees = (struct decision**)malloc(sizeof(struct decision*) * ntrees);
+	forest->ntrees = ntrees;
+	dt_create_targets(samples, count, targets, ntrees, threads,
+					  forest->trees, NULL);
+
+	free(targets);
+	free(p);
+	return forest;
+}
+
+int
+dt_forest_decide(const struct dt_forest *forest, const struct sample *sample)
+{
+	// The distinct decisions in order of appearance, and their votes
+	int *vals = (int*)malloc(sizeof(int) * forest->ntrees);
+	int *votes = (int*)malloc(sizeof(int) * forest->ntrees);
+	int unique = 0;
+
+	for (int i=0; i<forest->ntrees; i++) {
+		const int v = dt_decide(forest->trees[i], sample);
+		if (v == -1)
+			continue;
+
+		int j = 0;
+		while (j < unique && vals[j] != v)
+			j++;
+		if (j == unique) {
+			vals[unique] = v;
+			votes[unique++] = 0;
+		}
+		votes[j]++;
+	}
+
+	int val = -1;
+	int best = 0;
+	for (int j=0; j<unique; j++) {
+		if (votes[j] > best) {
+			val = vals[j];
+			best = votes[j];
+		}
+	}
+
+	free(vals);
+	free(votes);
+	return val;
+}
+
+void
+dt_forest_destroy(struct dt_forest *forest)
+{
+	if (!forest)
+		return;
+
+	for (int i=0; i<forest->ntrees; i++)
+		dt_destroy(forest->trees[i]);
+	free(forest->trees);
+	free(forest);
+}
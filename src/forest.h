@@ -0,0 +1,32 @@
+#ifndef __FOREST_H__
+#define __FOREST_H__
+
+#include "dtree.h"
+
+
+/* Forest
+ * An ensemble of extremely randomized trees (see dt_params.extra) on the
+ * same samples, deciding by majority vote. Tree [i] is trained with the
+ * seed of the configuration plus [i], and with one candidate per node
+ * unless the configuration sets "extra".
+ *
+ * The trees are trained together by dt_create_targets(), so the rows of
+ * the root are counted once for all of them.
+ */
+struct dt_forest {
+	struct decision **trees;
+	int ntrees;
+};
+
+struct dt_forest* dt_forest_create(const struct sample*, int count,
+								   const struct dt_params*, int ntrees,
+								   int threads);
+
+/* The decision of most trees, ties going to the decision reached first
+ * in tree order. Returns -1 if no tree decides the sample.
+ */
+int dt_forest_decide(const struct dt_forest*, const struct sample*);
+
+void dt_forest_destroy(struct dt_forest*);
+
+#endif /* __FOREST_H__ */
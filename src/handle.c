@@ -0,0 +1,209 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "handle.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+
+// Bytes and alignment of a reader slot, keeping the slots of readers on
+// separate lines
+#define HANDLE_SLOT_SIZE	64
+
+/* The epoch announced by a reader, or 0 outside of a decision. Epochs
+ * start at 1.
+ */
+struct dt_reader {
+	unsigned long epoch;
+	struct dt_handle *handle;
+	struct dt_reader *next;
+	char pad[HANDLE_SLOT_SIZE - sizeof(unsigned long) - 2 * sizeof(void*)];
+};
+
+struct handle_retired {
+	struct decision *tree;
+	unsigned long epoch;	// The epoch the tree was replaced in
+};
+
+struct dt_handle {
+	struct decision *tree;
+	unsigned long epoch;
+
+	// Publishers, registration and reclamation hold the lock
+	pthread_mutex_t lock;
+	struct dt_reader *readers;
+	struct handle_retired *retired;
+	int nretired;
+	int retired_cap;
+};
+
+static int handle_reclaim(struct dt_handle*);
+
+
+
+struct dt_handle*
+dt_handle_create(struct decision *tree)
+{
+	struct dt_handle *h = (struct dt_handle*)malloc(sizeof(struct dt_handle));
+	memset(h, 0, sizeof(struct dt_handle));
+	dt_grow(tree);
+	h->tree = tree;
+	h->epoch = 1;
+	pthread_mutex_init(&h->lock, NULL);
+	return h;
+}
+
+void
+dt_handle_destroy(struct dt_handle *h)
+{
+	if (!h)
+		return;
+
+	for (int i=0; i<h->nretired; i++)
+		dt_destroy(h->retired[i].tree);
+	dt_destroy(h->tree);
+
+	while (h->readers) {
+		struct dt_reader *r = h->readers;
+		h->readers = r->next;
+		free(r);
+	}
+
+	pthread_mutex_destroy(&h->lock);
+	free(h->retired);
+	free(h);
+}
+
+struct dt_reader*
+dt_handle_reader(struct dt_handle *h)
+{
+	void *slot;
+	if (posix_memalign(&slot, HANDLE_SLOT_SIZE, sizeof(struct dt_reader)))
+		return NULL;
+	struct dt_reader *r = (struct dt_reader*)slot;
+	memset(r, 0, sizeof(struct dt_reader));
+	r->handle = h;
+
+	pthread_mutex_lock(&h->lock);
+	r->next = h->readers;
+	h->readers = r;
+	pthread_mutex_unlock(&h->lock);
+	return r;
+}
+
+void
+dt_reader_release(struct dt_reader *r)
+{
+	struct dt_handle *h = r->handle;
+
+	pthread_mutex_lock(&h->lock);
+	struct dt_reader **p = &h->readers;
+	while (*p != r)
+		p = &(*p)->next;
+	*p = r->next;
+	pthread_mutex_unlock(&h->lock);
+
+	free(r);
+}
+
+const struct decision*
+dt_reader_enter(struct dt_reader *r)
+{
+	struct dt_handle *h = r->handle;
+
+	// The announcement is ordered before loading the tree. A publisher
+	// either sees it when reclaiming, or published before the load.
+	unsigned long e = __atomic_load_n(&h->epoch, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&r->epoch, e, __ATOMIC_SEQ_CST);
+	return __atomic_load_n(&h->tree, __ATOMIC_SEQ_CST);
+}
+
+void
+dt_reader_leave(struct dt_reader *r)
+{
+	__atomic_store_n(&r->epoch, 0, __ATOMIC_RELEASE);
+}
+
+int
+dt_handle_decide(struct dt_reader *r, const struct sample *sample)
+{
+	const struct decision *tree = dt_reader_enter(r);
+	int res = dt_decide(tree, sample);
+	dt_reader_leave(r);
+	return res;
+}
+
+void
+dt_handle_decide_batch(struct dt_reader *r, const struct sample *samples,
+					   int count, int *out)
+{
+	const struct decision *tree = dt_reader_enter(r);
+	dt_decide_batch(tree, samples, count, out);
+	dt_reader_leave(r);
+}
+
+void
+dt_handle_publish(struct dt_handle *h, struct decision *tree)
+{
+	dt_grow(tree);
+
+	pthread_mutex_lock(&h->lock);
+	struct decision *old = __atomic_exchange_n(&h->tree, tree,
+											   __ATOMIC_SEQ_CST);
+	unsigned long e = __atomic_fetch_add(&h->epoch, 1, __ATOMIC_SEQ_CST);
+
+	if (h->nretired == h->retired_cap) {
+		h->retired_cap = h->retired_cap ? h->retired_cap * 2 : 8;
+		h->retired = (struct handle_retired*)realloc(h->retired,
+				sizeof(struct handle_retired) * h->retired_cap);
+	}
+	h->retired[h->nretired].tree = old;
+	h->retired[h->nretired].epoch = e;
+	h->nretired++;
+
+	handle_reclaim(h);
+	pthread_mutex_unlock(&h->lock);
+}
+
+int
+dt_handle_reclaim(struct dt_handle *h)
+{
+	pthread_mutex_lock(&h->lock);
+	int n = handle_reclaim(h);
+	pthread_mutex_unlock(&h->lock);
+	return n;
+}
+
+void
+dt_handle_synchronize(struct dt_handle *h)
+{
+	const struct timespec pause = { 0, 100000 };
+	while (dt_handle_reclaim(h) > 0)
+		nanosleep(&pause, NULL);
+}
+
+
+/* Destroy the retired trees replaced before the oldest epoch announced
+ * by a reader. Called with the lock held.
+ */
+static int
+handle_reclaim(struct dt_handle *h)
+{
+	unsigned long oldest = 0;
+	for (struct dt_reader *r = h->readers; r; r=r->next) {
+		unsigned long e = __atomic_load_n(&r->epoch, __ATOMIC_SEQ_CST);
+		if (e && (!oldest || e < oldest))
+			oldest = e;
+	}
+
+	int n = 0;
+	for (int i=0; i<h->nretired; i++) {
+		if (oldest && h->retired[i].epoch >= oldest)
+			h->retired[n++] = h->retired[i];
+		else
+			dt_destroy(h->retired[i].tree);
+	}
+	h->nretired = n;
+	return n;
+}
@@ -0,0 +1,66 @@
+#ifndef __HANDLE_H__
+#define __HANDLE_H__
+
+#include "dtree.h"
+
+
+/* Model handle
+ * Holds the tree served to concurrent deciders while a new one is
+ * trained. Readers decide through the handle without locks: entering
+ * announces the current epoch in a slot of the reader, and leaving
+ * clears it. Readers never wait, and never write shared data.
+ *
+ * dt_handle_publish() swaps the tree atomically, and retires the old
+ * one tagged with the epoch it was replaced in. A retired tree is
+ * destroyed once no reader announces that epoch or an earlier one, as
+ * a reader entering later can only load a newer tree. Publishers
+ * serialize among themselves on a mutex.
+ *
+ * Each reader is used by a single thread at a time, and must not enter
+ * twice before leaving.
+ */
+struct dt_handle;
+struct dt_reader;
+
+/* Create a handle serving [tree], which the handle takes ownership of.
+ */
+struct dt_handle* dt_handle_create(struct decision*);
+
+/* Destroy the handle with the current and all retired trees. There may
+ * be no readers left.
+ */
+void dt_handle_destroy(struct dt_handle*);
+
+/* Register a reader of the handle, and release it. Returns NULL if the
+ * reader could not be allocated.
+ */
+struct dt_reader* dt_handle_reader(struct dt_handle*);
+void dt_reader_release(struct dt_reader*);
+
+/* The current tree, which stays valid until the reader leaves.
+ */
+const struct decision* dt_reader_enter(struct dt_reader*);
+void dt_reader_leave(struct dt_reader*);
+
+/* Decide by the current tree. A batch is decided by a single tree.
+ */
+int dt_handle_decide(struct dt_reader*, const struct sample*);
+void dt_handle_decide_batch(struct dt_reader*, const struct sample*,
+							int count, int *out);
+
+/* Serve [tree] instead of the current one, taking ownership of it. The
+ * tree is fully grown first, so that readers never wait for a pending
+ * subtree. Retired trees are reclaimed as far as the readers allow.
+ */
+void dt_handle_publish(struct dt_handle*, struct decision*);
+
+/* Destroy the retired trees no reader can hold. Returns the number of
+ * trees still retired.
+ */
+int dt_handle_reclaim(struct dt_handle*);
+
+/* Wait until every retired tree is destroyed. Only the caller waits.
+ */
+void dt_handle_synchronize(struct dt_handle*);
+
+#endif /* __HANDLE_H__ */
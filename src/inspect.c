@@ -0,0 +1,397 @@
+#include "inspect.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+/* A sibling chain on the current path, and the node of the chain the
+ * walk is currently below.
+ */
+struct dt_frame {
+	const struct decision *head;
+	const struct decision *d;
+	long id;
+};
+
+struct dt_path {
+	int size;
+	int cap;
+	struct dt_frame *f;
+};
+
+/* Callbacks of dt_walk(). A node without "dest" is a leaf. Leaves hanging
+ * directly below the root, or below a branch, are reported with the path
+ * leading to them; branches are reported on entry and on exit.
+ */
+struct dt_walker {
+	void (*chain_begin)(struct dt_walker*, struct dt_path*);
+	void (*chain_end)(struct dt_walker*, struct dt_path*);
+	void (*branch_begin)(struct dt_walker*, struct dt_path*);
+	void (*branch_end)(struct dt_walker*, struct dt_path*);
+	void (*leaf)(struct dt_walker*, struct dt_path*, const struct decision*);
+
+	FILE *file;
+	long next_id;
+	struct dt_stats *stats;
+};
+
+static void dt_walk(const struct decision*, struct dt_walker*);
+static void dt_path_push(struct dt_path*, const struct decision *head);
+
+static void print_node(FILE*, const struct decision*);
+static void path_leaf(struct dt_walker*, struct dt_path*, const struct decision*);
+
+static void json_chain_begin(struct dt_walker*, struct dt_path*);
+static void json_chain_end(struct dt_walker*, struct dt_path*);
+static void json_branch_begin(struct dt_walker*, struct dt_path*);
+static void json_branch_end(struct dt_walker*, struct dt_path*);
+static void json_leaf(struct dt_walker*, struct dt_path*, const struct decision*);
+
+static void dot_chain_begin(struct dt_walker*, struct dt_path*);
+static void dot_leaf(struct dt_walker*, struct dt_path*, const struct decision*);
+
+static void validate_branch(struct dt_walker*, struct dt_path*);
+static void validate_leaf(struct dt_walker*, struct dt_path*,
+						  const struct decision*);
+static void validate_node(struct dt_stats*, struct dt_path*,
+						  const struct decision*);
+
+
+
+bool
+dt_export(const struct decision *dec, FILE *file, enum dt_format format)
+{
+	struct dt_walker w;
+	memset(&w, 0, sizeof(w));
+	w.file = file;
+
+	switch (format) {
+		case DT_FORMAT_PATH:
+			w.leaf = path_leaf;
+			break;
+
+		case DT_FORMAT_JSON:
+			w.chain_begin = json_chain_begin;
+			w.chain_end = json_chain_end;
+			w.branch_begin = json_branch_begin;
+			w.branch_end = json_branch_end;
+			w.leaf = json_leaf;
+			break;
+
+		case DT_FORMAT_DOT:
+			w.chain_begin = dot_chain_begin;
+			w.leaf = dot_leaf;
+			fprintf(file, "digraph dtree {\n");
+			break;
+	}
+
+	dt_walk(dec, &w);
+
+	if (format == DT_FORMAT_JSON)
+		fprintf(file, "\n");
+	else if (format == DT_FORMAT_DOT)
+		fprintf(file, "}\n");
+
+	return !ferror(file);
+}
+
+bool
+dt_format_parse(const char *str, enum dt_format *format)
+{
+	if (!strcmp(str, "path"))
+		*format = DT_FORMAT_PATH;
+	else if (!strcmp(str, "json"))
+		*format = DT_FORMAT_JSON;
+	else if (!strcmp(str, "dot"))
+		*format = DT_FORMAT_DOT;
+	else
+		return false;
+	return true;
+}
+
+bool
+dt_validate(const struct decision *dec, struct dt_stats *stats)
+{
+	memset(stats, 0, sizeof(struct dt_stats));
+	stats->min_purity = 1.0;
+
+	struct dt_walker w;
+	memset(&w, 0, sizeof(w));
+	w.branch_begin = validate_branch;
+	w.leaf = validate_leaf;
+	w.stats = stats;
+
+	dt_walk(dec, &w);
+
+	return !stats->field_errors && !stats->parent_errors;
+}
+
+void
+dt_stats_print(const struct dt_stats *stats, FILE *file)
+{
+	fprintf(file, "\tnodes:  %li\n", stats->nodes);
+	fprintf(file, "\tleaves: %li\n", stats->leaves);
+	fprintf(file, "\tdepth:  %i\n", stats->depth);
+
+	for (int i=0; i<DT_STATS_DEPTHS; i++) {
+		if (!stats->leaves_at[i])
+			continue;
+		fprintf(file, "\t  %s%2i: %li leaves\n",
+				i == DT_STATS_DEPTHS-1 ? ">=" : "  ", i, stats->leaves_at[i]);
+	}
+
+	if (stats->samples) {
+		fprintf(file, "\tpurity: %g (lowest leaf %g)\n",
+				(double)stats->agree / (double)stats->samples,
+				stats->min_purity);
+	}
+}
+
+
+/** Walk **/
+static void
+dt_walk(const struct decision *dec, struct dt_walker *w)
+{
+	struct dt_path path;
+	memset(&path, 0, sizeof(path));
+
+	if (!dec)
+		return;
+
+	if (!dec->dest) {
+		w->leaf(w, &path, dec);
+		return;
+	}
+
+	dt_path_push(&path, dec);
+	if (w->chain_begin)
+		w->chain_begin(w, &path);
+
+	while (path.size > 0) {
+		struct dt_frame *top = &path.f[path.size-1];
+
+		// The chain is done, continue with the next sibling above it
+		if (!top->d) {
+			if (w->chain_end)
+				w->chain_end(w, &path);
+			path.size--;
+			if (path.size == 0)
+				break;
+
+			top = &path.f[path.size-1];
+			if (w->branch_end)
+				w->branch_end(w, &path);
+			top->d = top->d->next;
+			continue;
+		}
+
+		const struct decision *d = top->d;
+		if (!d->dest) {
+			w->leaf(w, &path, d);
+			top->d = d->next;
+			continue;
+		}
+
+		if (w->branch_begin)
+			w->branch_begin(w, &path);
+
+		if (!d->dest->dest) {
+			w->leaf(w, &path, d->dest);
+			if (w->branch_end)
+				w->branch_end(w, &path);
+			top->d = d->next;
+		} else {
+			dt_path_push(&path, d->dest);
+			if (w->chain_begin)
+				w->chain_begin(w, &path);
+		}
+	}
+
+	free(path.f);
+}
+
+static void
+dt_path_push(struct dt_path *path, const struct decision *head)
+{
+	if (path->size == path->cap) {
+		path->cap = path->cap ? path->cap * 2 : 16;
+		int sz = sizeof(struct dt_frame) * path->cap;
+		path->f = (struct dt_frame*)realloc(path->f, sz);
+	}
+
+	struct dt_frame *f = &path->f[path->size++];
+	f->head = head;
+	f->d = head;
+	f->id = 0;
+}
+
+
+/** Path format **/
+static void
+print_node(FILE *file, const struct decision *d)
+{
+	if (!d->set) {
+		fprintf(file, "{%u => %i}", d->field, d->value);
+		return;
+	}
+
+	fprintf(file, "{%u in ", d->field);
+	for (int i=0; i<d->set_size; i++)
+		fprintf(file, "%s%i", i ? "," : "", d->set[i]);
+	fprintf(file, "}");
+}
+
+static void
+path_leaf(struct dt_walker *w, struct dt_path *path, const struct decision *leaf)
+{
+	for (int i=0; i<path->size; i++) {
+		const struct decision *d = path->f[i].d;
+		if (d != leaf)
+			print_node(w->file, d);
+	}
+	print_node(w->file, leaf);
+	fprintf(w->file, "\n");
+}
+
+
+/** JSON **/
+static void
+json_chain_begin(struct dt_walker *w, struct dt_path *path)
+{
+	(void)path;
+	fprintf(w->file, "[");
+}
+
+static void
+json_chain_end(struct dt_walker *w, struct dt_path *path)
+{
+	(void)path;
+	fprintf(w->file, "]");
+}
+
+static void
+json_branch_begin(struct dt_walker *w, struct dt_path *path)
+{
+	const struct dt_frame *top = &path->f[path->size-1];
+	const struct decision *d = top->d;
+	fprintf(w->file, "%s{\"field\":%u,\"value\":%i,",
+			d == top->head ? "" : ",", d->field, d->value);
+
+	if (d->set) {
+		fprintf(w->file, "\"set\":[");
+		for (int i=0; i<d->set_size; i++)
+			fprintf(w->file, "%s%i", i ? "," : "", d->set[i]);
+		fprintf(w->file, "],");
+	}
+
+	fprintf(w->file, "\"dest\":");
+}
+
+static void
+json_branch_end(struct dt_walker *w, struct dt_path *path)
+{
+	(void)path;
+	fprintf(w->file, "}");
+}
+
+static void
+json_leaf(struct dt_walker *w, struct dt_path *path, const struct decision *leaf)
+{
+	// Leaves inside a chain are siblings of the other nodes
+	const struct dt_frame *top = path->size ? &path->f[path->size-1] : NULL;
+	if (top && top->d == leaf && leaf != top->head)
+		fprintf(w->file, ",");
+
+	fprintf(w->file, "{\"field\":%u,\"value\":%i,\"samples\":%i,\"agree\":%i}",
+			leaf->field, leaf->value, leaf->samples, leaf->agree);
+}
+
+
+/** Graphviz **/
+static void
+dot_chain_begin(struct dt_walker *w, struct dt_path *path)
+{
+	struct dt_frame *top = &path->f[path->size-1];
+	top->id = w->next_id++;
+	fprintf(w->file, "\tn%li [label=\"field %u\"];\n", top->id, top->head->field);
+
+	if (path->size > 1) {
+		const struct dt_frame *up = &path->f[path->size-2];
+		fprintf(w->file, "\tn%li -> n%li [label=\"", up->id, top->id);
+		print_node(w->file, up->d);
+		fprintf(w->file, "\"];\n");
+	}
+}
+
+static void
+dot_leaf(struct dt_walker *w, struct dt_path *path, const struct decision *leaf)
+{
+	const long id = w->next_id++;
+	fprintf(w->file, "\tn%li [shape=box,label=\"%u => %i\"];\n",
+			id, leaf->field, leaf->value);
+
+	if (path->size > 0) {
+		const struct dt_frame *top = &path->f[path->size-1];
+		fprintf(w->file, "\tn%li -> n%li [label=\"", top->id, id);
+		print_node(w->file, top->d);
+		fprintf(w->file, "\"];\n");
+	}
+}
+
+
+/** Validation **/
+static void
+validate_branch(struct dt_walker *w, struct dt_path *path)
+{
+	validate_node(w->stats, path, path->f[path->size-1].d);
+}
+
+static void
+validate_leaf(struct dt_walker *w, struct dt_path *path,
+			  const struct decision *leaf)
+{
+	struct dt_stats *stats = w->stats;
+
+	// Leaves inside a chain are checked like the branches of the chain.
+	// Other leaves are the single node of the chain below a branch.
+	const struct dt_frame *top = path->size ? &path->f[path->size-1] : NULL;
+	if (top && top->d == leaf) {
+		validate_node(stats, path, leaf);
+	} else {
+		stats->nodes++;
+		if (top && leaf->parent != top->head)
+			stats->parent_errors++;
+	}
+
+	const int depth = (top && top->d == leaf) ? path->size - 1 : path->size;
+	stats->leaves++;
+	if (depth > stats->depth)
+		stats->depth = depth;
+	stats->leaves_at[depth < DT_STATS_DEPTHS ? depth : DT_STATS_DEPTHS-1]++;
+
+	if (leaf->samples > 0) {
+		double purity = (double)leaf->agree / (double)leaf->samples;
+		if (purity < stats->min_purity)
+			stats->min_purity = purity;
+		stats->samples += leaf->samples;
+		stats->agree += leaf->agree;
+	}
+}
+
+/* Checks a node in the chain on top of the path: it must test the field
+ * of the chain head, and point to the head of the chain above.
+ */
+static void
+validate_node(struct dt_stats *stats, struct dt_path *path,
+			  const struct decision *d)
+{
+	const struct dt_frame *top = &path->f[path->size-1];
+	const struct decision *parent = NULL;
+	if (path->size > 1)
+		parent = path->f[path->size-2].head;
+
+	stats->nodes++;
+	if (d->field != top->head->field)
+		stats->field_errors++;
+	if (d->parent != parent)
+		stats->parent_errors++;
+}
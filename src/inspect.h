@@ -0,0 +1,56 @@
+#ifndef __INSPECT_H__
+#define __INSPECT_H__
+
+#include "dtree.h"
+#include <stdio.h>
+
+
+/* Export and validation
+ * Both walk the tree once, depth first, keeping the current path on an
+ * explicit stack. They run in time linear in the number of nodes and do
+ * not allocate per node, so they are usable on trees with millions of
+ * nodes.
+ */
+
+enum dt_format {
+	DT_FORMAT_PATH,		// One line per leaf: "{field => value}" per node
+	DT_FORMAT_JSON,		// Nested arrays of sibling chains
+	DT_FORMAT_DOT,		// Graphviz digraph
+};
+
+bool dt_export(const struct decision*, FILE*, enum dt_format);
+
+// Parses "path", "json" or "dot". Returns false for anything else.
+bool dt_format_parse(const char*, enum dt_format*);
+
+
+// Leaves deeper than this are counted in the last histogram bucket
+#define DT_STATS_DEPTHS 32
+
+struct dt_stats {
+	long nodes;
+	long leaves;
+	int depth;
+
+	// The number of leaves at each depth, the root chain being depth 1
+	long leaves_at[DT_STATS_DEPTHS];
+
+	// Training samples over all leaves, those agreeing with their leaf and
+	// the lowest purity (agree / samples) of any leaf with samples.
+	long samples;
+	long agree;
+	double min_purity;
+
+	// Sibling chains testing more than one field, and nodes whose parent
+	// is not the head of the chain above them.
+	long field_errors;
+	long parent_errors;
+};
+
+/* Walk the tree, filling in "stats". Returns true if no errors were
+ * found.
+ */
+bool dt_validate(const struct decision*, struct dt_stats*);
+void dt_stats_print(const struct dt_stats*, FILE*);
+
+#endif /* __INSPECT_H__ */
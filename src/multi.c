@@ -0,0 +1,438 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "multi.h"
+#include "counts.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+
+/* A tree growing a node from the rows of a group. "dec" is the chain
+ * chosen for the node, with "nchild" branches or none for a leaf.
+ */
+struct multi_member {
+	int target;
+	struct decision **slot;
+	struct decision *parent;
+	struct decision *dec;
+	int nchild;
+	bool done;
+};
+
+struct multi_group {
+	int *rows;
+	int nrows;
+	int depth;
+	unsigned used;			// Bitmask of the fields used on the path
+	struct multi_member *m;
+	int nmembers;
+};
+
+/* The label tuples of the rows. Tuple "combo" has label
+ * labels[combo * ntargets + t] for tree [t].
+ */
+struct multi_labels {
+	int ntargets;
+	int *combo;
+	int *labels;
+	int ncombos;
+};
+
+/* The groups of the current level, handed out to the workers in turn */
+struct multi_job {
+	const struct sample *samples;
+	const struct dt_target *targets;
+	struct multi_labels lab;
+
+	struct multi_group *groups;
+	int ngroups;
+	int taken;
+	pthread_mutex_t lock;
+};
+
+/* A worker collects the groups of the next level, and the time spent on
+ * each tree.
+ */
+struct multi_worker {
+	struct multi_job *job;
+	struct count_table joint;
+	struct count_table t;
+	struct multi_group *next;
+	int nnext;
+	double *seconds;
+	pthread_t thread;
+};
+
+static void* multi_worker_main(void*);
+static void multi_group_split(struct multi_worker*, struct multi_group*);
+static void multi_labels_init(struct multi_labels*, const struct sample*,
+							  const struct dt_target*, int ntargets, int count);
+static void multi_count(const struct sample*, const struct multi_group*,
+						const struct multi_labels*, struct count_table*);
+static void multi_marginal(const struct count_table *joint,
+						   const struct multi_labels*, int target,
+						   struct count_table*);
+static bool multi_same_split(const struct decision*, const struct decision*);
+static void multi_children(const struct sample*, const struct multi_group*,
+						   const struct multi_member *leader,
+						   struct multi_group **next, int *nnext);
+
+
+
+void
+dt_create_targets(const struct sample *samples, int count,
+				  const struct dt_target *targets, int ntargets, int threads,
+				  struct decision **trees, double *seconds)
+{
+	struct multi_job job;
+	memset(&job, 0, sizeof(job));
+	job.samples = samples;
+	job.targets = targets;
+	multi_labels_init(&job.lab, samples, targets, ntargets, count);
+	pthread_mutex_init(&job.lock, NULL);
+
+	struct multi_group *root;
+	root = (struct multi_group*)malloc(sizeof(struct multi_group));
+	root->rows = (int*)malloc(sizeof(int) * (count + 1));
+	root->nrows = count;
+	root->depth = 0;
+	root->used = 0;
+	root->nmembers = ntargets;
+	root->m = (struct multi_member*)malloc(sizeof(struct multi_member)
+										   * ntargets);
+	for (int i=0; i<count; i++)
+		root->rows[i] = i;
+	for (int t=0; t<ntargets; t++) {
+		memset(&root->m[t], 0, sizeof(struct multi_member));
+		root->m[t].target = t;
+		root->m[t].slot = &trees[t];
+	}
+	job.groups = root;
+	job.ngroups = 1;
+
+	if (threads < 1)
+		threads = 1;
+	struct multi_worker *workers;
+	workers = (struct multi_worker*)malloc(sizeof(struct multi_worker) * threads);
+	for (int i=0; i<threads; i++) {
+		memset(&workers[i], 0, sizeof(struct multi_worker));
+		workers[i].job = &job;
+		count_table_init(&workers[i].joint);
+		count_table_init(&workers[i].t);
+		workers[i].seconds = (double*)calloc(ntargets, sizeof(double));
+	}
+
+	while (job.ngroups > 0) {
+		const int n = threads < job.ngroups ? threads : job.ngroups;
+		job.taken = 0;
+		for (int i=1; i<n; i++)
+			pthread_create(&workers[i].thread, NULL, multi_worker_main, &workers[i]);
+		multi_worker_main(&workers[0]);
+		for (int i=1; i<n; i++)
+			pthread_join(workers[i].thread, NULL);
+
+		// The next level holds the groups of every worker
+		int nnext = 0;
+		for (int i=0; i<n; i++)
+			nnext += workers[i].nnext;
+		struct multi_group *next;
+		next = (struct multi_group*)malloc(sizeof(struct multi_group) * (nnext + 1));
+		nnext = 0;
+		for (int i=0; i<n; i++) {
+			if (workers[i].nnext > 0)
+				memcpy(next + nnext, workers[i].next,
+					   sizeof(struct multi_group) * workers[i].nnext);
+			nnext += workers[i].nnext;
+			free(workers[i].next);
+			workers[i].next = NULL;
+			workers[i].nnext = 0;
+		}
+
+		free(job.groups);
+		job.groups = next;
+		job.ngroups = nnext;
+	}
+
+	for (int i=0; i<threads; i++) {
+		for (int t=0; seconds && t<ntargets; t++)
+			seconds[t] += workers[i].seconds[t];
+		count_table_free(&workers[i].joint);
+		count_table_free(&workers[i].t);
+		free(workers[i].seconds);
+	}
+
+	pthread_mutex_destroy(&job.lock);
+	free(workers);
+	free(job.groups);
+	free(job.lab.combo);
+	free(job.lab.labels);
+}
+
+void
+dt_create_multi(const struct sample *samples, int count,
+				const int *const *labels, int ntargets,
+				const struct dt_params *params, struct decision **trees)
+{
+	struct dt_target *targets;
+	targets = (struct dt_target*)malloc(sizeof(struct dt_target) * ntargets);
+	for (int t=0; t<ntargets; t++) {
+		targets[t].labels = labels[t];
+		targets[t].params = params;
+	}
+
+	dt_create_targets(samples, count, targets, ntargets, 1, trees, NULL);
+	free(targets);
+}
+
+
+/** Levels **/
+static void*
+multi_worker_main(void *arg)
+{
+	struct multi_worker *w = (struct multi_worker*)arg;
+	struct multi_job *job = w->job;
+
+	while (true) {
+		pthread_mutex_lock(&job->lock);
+		const int g = job->taken++;
+		pthread_mutex_unlock(&job->lock);
+		if (g >= job->ngroups)
+			break;
+
+		multi_group_split(w, &job->groups[g]);
+	}
+
+	return NULL;
+}
+
+/* Count the rows of the group, split the node of every member and append
+ * the groups of the children to the next level of the worker.
+ */
+static void
+multi_group_split(struct multi_worker *w, struct multi_group *group)
+{
+	struct multi_job *job = w->job;
+	struct timespec begin;
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	count_table_clear(&w->joint);
+	multi_count(job->samples, group, &job->lab, &w->joint);
+
+	bool excluded[SAMPLE_NUM_FIELDS];
+	for (int i=0; i<SAMPLE_NUM_FIELDS; i++)
+		excluded[i] = (group->used & (1u << i)) != 0;
+
+	for (int i=0; i<group->nmembers; i++) {
+		struct multi_member *m = &group->m[i];
+		multi_marginal(&w->joint, &job->lab, m->target, &w->t);
+		m->dec = dt_split_node(&w->t, excluded, group->depth,
+							   job->targets[m->target].params, &m->nchild);
+		for (struct decision *d = m->dec; d; d=d->next)
+			d->parent = m->parent;
+		*m->slot = m->dec;
+	}
+
+	// Trees taking the same split share the children
+	for (int i=0; i<group->nmembers; i++) {
+		if (group->m[i].nchild == 0 || group->m[i].done)
+			continue;
+		for (int j=i+1; j<group->nmembers; j++) {
+			if (multi_same_split(group->m[i].dec, group->m[j].dec))
+				group->m[j].done = true;
+		}
+		multi_children(job->samples, group, &group->m[i], &w->next, &w->nnext);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double elapsed = (double)(end.tv_sec - begin.tv_sec)
+					 + (double)(end.tv_nsec - begin.tv_nsec) / 1e9;
+	for (int i=0; i<group->nmembers; i++)
+		w->seconds[group->m[i].target] += elapsed / group->nmembers;
+
+	free(group->rows);
+	free(group->m);
+}
+
+
+/** Label tuples **/
+static void
+multi_labels_init(struct multi_labels *lab, const struct sample *samples,
+				  const struct dt_target *targets, int ntargets, int count)
+{
+	lab->ntargets = ntargets;
+	lab->combo = (int*)malloc(sizeof(int) * (count + 1));
+	lab->labels = (int*)malloc(sizeof(int) * ntargets * (count + 1));
+	lab->ncombos = 0;
+
+	// Open addressing over the tuples, slots hold index+1
+	int nslots = 16;
+	while (nslots < 2 * count)
+		nslots *= 2;
+	int *slot = (int*)calloc(nslots, sizeof(int));
+
+	int *tuple = (int*)malloc(sizeof(int) * ntargets);
+
+	for (int i=0; i<count; i++) {
+		unsigned h = 2166136261u;
+		for (int t=0; t<ntargets; t++) {
+			if (targets[t].labels)
+				tuple[t] = targets[t].labels[i];
+			else
+				tuple[t] = field_value(&samples[i], SAMPLE_RESULT_FIELD);
+			h = (h ^ (unsigned)tuple[t]) * 16777619u;
+		}
+
+		unsigned s = h & (nslots - 1);
+		int c = -1;
+		while (slot[s]) {
+			const int *other = &lab->labels[(slot[s] - 1) * ntargets];
+			int t = 0;
+			while (t < ntargets && other[t] == tuple[t])
+				t++;
+			if (t == ntargets) {
+				c = slot[s] - 1;
+				break;
+			}
+			s = (s + 1) & (nslots - 1);
+		}
+
+		if (c < 0) {
+			c = lab->ncombos++;
+			memcpy(&lab->labels[c * ntargets], tuple, sizeof(int) * ntargets);
+			slot[s] = c + 1;
+		}
+		lab->combo[i] = c;
+	}
+
+	free(tuple);
+	free(slot);
+}
+
+
+/** Counting **/
+/* Count the rows of the group with the label tuple as the result. The
+ * result field itself holds the tuple, so that it can be replaced by the
+ * label of each tree.
+ */
+static void
+multi_count(const struct sample *samples, const struct multi_group *group,
+			const struct multi_labels *lab, struct count_table *joint)
+{
+	for (int i=0; i<group->nrows; i++) {
+		const int row = group->rows[i];
+		const int c = lab->combo[row];
+		for (int f=0; f<SAMPLE_NUM_FIELDS; f++) {
+			int v = f == SAMPLE_RESULT_FIELD ? c : field_value(&samples[row], f);
+			count_table_add(joint, f, v, c, 1);
+		}
+	}
+}
+
+/* The table of tree [target] over the rows of the joint table. The joint
+ * entries are in order of first appearance, so the summed entries are
+ * too, as if the rows had been counted with the labels of the tree.
+ */
+static void
+multi_marginal(const struct count_table *joint, const struct multi_labels *lab,
+			   int target, struct count_table *t)
+{
+	count_table_clear(t);
+	for (int i=0; i<joint->size; i++) {
+		const struct count_entry *e = &joint->e[i];
+		const int label = lab->labels[e->result * lab->ntargets + target];
+		const int v = e->field == SAMPLE_RESULT_FIELD ? label : e->value;
+		count_table_add(t, e->field, v, label, e->count);
+	}
+}
+
+
+/** Splitting **/
+static bool
+multi_same_split(const struct decision *a, const struct decision *b)
+{
+	for (; a && b; a=a->next, b=b->next) {
+		if (a->field != b->field || a->value != b->value ||
+			a->set_size != b->set_size || !a->set != !b->set)
+			return false;
+		if (a->set && memcmp(a->set, b->set, sizeof(int) * a->set_size))
+			return false;
+	}
+
+	return !a && !b;
+}
+
+/* Append a group to "next" for each branch of [leader], holding the rows
+ * of the branch in order. The members are the trees of the group taking
+ * the same split as [leader].
+ */
+static void
+multi_children(const struct sample *samples, const struct multi_group *group,
+			   const struct multi_member *leader, struct multi_group **next,
+			   int *nnext)
+{
+	const unsigned field = leader->dec->field;
+	const int nchild = leader->nchild;
+	const bool subset = leader->dec->set != NULL;
+
+	// Map every value of the field to its branch
+	int npairs = 0;
+	int *pairs = dt_split_pairs(leader->dec, &npairs);
+
+	int *child = (int*)malloc(sizeof(int) * (group->nrows + 1));
+	int *sizes = (int*)calloc(nchild, sizeof(int));
+	for (int i=0; i<group->nrows; i++) {
+		const int v = field_value(&samples[group->rows[i]], field);
+		child[i] = dt_pair_find(pairs, npairs, v);
+		sizes[child[i]]++;
+	}
+
+	int sz = sizeof(struct multi_group) * (*nnext + nchild);
+	*next = (struct multi_group*)realloc(*next, sz);
+
+	int nmembers = 0;
+	for (const struct multi_member *m = leader; m < group->m + group->nmembers; m++) {
+		if (m == leader || (m->nchild > 0 && m->done &&
+							multi_same_split(leader->dec, m->dec)))
+			nmembers++;
+	}
+
+	int c = 0;
+	for (struct decision *d = leader->dec; d; d=d->next, c++) {
+		struct multi_group *g = &(*next)[*nnext + c];
+		g->rows = (int*)malloc(sizeof(int) * (sizes[c] + 1));
+		g->nrows = 0;
+		g->depth = group->depth + 1;
+		g->used = subset ? group->used : group->used | (1u << field);
+		g->m = (struct multi_member*)malloc(sizeof(struct multi_member) * nmembers);
+		g->nmembers = 0;
+	}
+
+	for (int i=0; i<group->nrows; i++) {
+		struct multi_group *g = &(*next)[*nnext + child[i]];
+		g->rows[g->nrows++] = group->rows[i];
+	}
+
+	// The members point the branches of their own chains to the group
+	for (const struct multi_member *m = leader; m < group->m + group->nmembers; m++) {
+		if (m != leader && !(m->nchild > 0 && m->done &&
+							 multi_same_split(leader->dec, m->dec)))
+			continue;
+
+		c = 0;
+		for (struct decision *d = m->dec; d; d=d->next, c++) {
+			struct multi_group *g = &(*next)[*nnext + c];
+			struct multi_member *n = &g->m[g->nmembers++];
+			memset(n, 0, sizeof(struct multi_member));
+			n->target = m->target;
+			n->slot = &d->dest;
+			n->parent = m->dec;
+		}
+	}
+
+	*nnext += nchild;
+	free(pairs);
+	free(child);
+	free(sizes);
+}
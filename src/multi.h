@@ -0,0 +1,46 @@
+#ifndef __MULTI_H__
+#define __MULTI_H__
+
+#include "dtree.h"
+
+
+/* Multi-target training
+ * Trains several trees on the same samples. Tree [t] equals the tree
+ * dt_create_params() trains with the configuration of the target, on the
+ * samples with the result field replaced by the labels of the target.
+ *
+ * The trees are grown one level at a time, like the sharded trainer. The
+ * nodes of different trees holding the same rows form a group. The rows
+ * of a group are counted once, into a count_table whose results are the
+ * label tuples of the rows, and the table of each tree is summed from
+ * it. Trees splitting a group the same way keep sharing the children:
+ * at the root, all trees share one pass over the rows, and trees only
+ * differing in "max_depth" share every level above the shallowest limit.
+ * The groups of a level are counted and split on a pool of threads.
+ */
+
+/* A tree to train: its labels, or NULL for the result field of the
+ * samples, and its configuration.
+ */
+struct dt_target {
+	const int *labels;
+	const struct dt_params *params;
+};
+
+/* Train a tree for each of the [ntargets] targets on [threads] threads,
+ * assigning the trees to "trees". Unless "seconds" is NULL, the time
+ * spent on each group is divided among the trees sharing it and added to
+ * seconds[t].
+ */
+void dt_create_targets(const struct sample*, int count,
+					   const struct dt_target*, int ntargets, int threads,
+					   struct decision **trees, double *seconds);
+
+/* Train [ntargets] trees with the same configuration, the labels of tree
+ * [t] being labels[t][0..count-1].
+ */
+void dt_create_multi(const struct sample*, int count, const int *const *labels,
+					 int ntargets, const struct dt_params*,
+					 struct decision **trees);
+
+#endif /* __MULTI_H__ */
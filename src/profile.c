@@ -0,0 +1,164 @@
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+static int dt_count_nodes(const struct decision*, int *set_values);
+static struct decision* dt_layout_chain(const struct decision*,
+										struct decision *parent,
+										struct decision *nodes, int *pos,
+										int **sets);
+static void dt_profile_save_chain(const struct decision*, FILE*);
+static bool dt_profile_load_chain(struct decision*, FILE*);
+
+
+
+int
+dt_decide_profile(struct decision *dec, const struct sample *sample)
+{
+	while (dec && dec->dest) {
+		while (dec && !dt_match(dec, field_value(sample, dec->field)))
+			dec = dec->next;
+		if (!dec)
+			return -1;
+		dec->hits++;
+		dec = dec->dest;
+		dt_expand(dec);
+	}
+
+	dec->hits++;
+	return dec->value;
+}
+
+struct decision*
+dt_relayout(const struct decision *dec)
+{
+	// The sets of subset nodes are stored behind the nodes
+	int set_values = 0;
+	const int count = dt_count_nodes(dec, &set_values);
+	const size_t sz = sizeof(struct decision) * count;
+	struct decision *nodes;
+	nodes = (struct decision*)malloc(sz + sizeof(int) * set_values);
+	memset(nodes, 0, sz);
+
+	int pos = 0;
+	int *sets = (int*)((char*)nodes + sz);
+	dt_layout_chain(dec, NULL, nodes, &pos, &sets);
+	nodes[0].flags |= DT_FLAT;
+
+	return nodes;
+}
+
+bool
+dt_profile_save(const struct decision *dec, FILE *file)
+{
+	int set_values = 0;
+	fprintf(file, "dtprof 1 %i\n", dt_count_nodes(dec, &set_values));
+	dt_profile_save_chain(dec, file);
+	return !ferror(file);
+}
+
+bool
+dt_profile_load(struct decision *dec, FILE *file)
+{
+	int version = 0;
+	int count = 0;
+	if (fscanf(file, "dtprof %i %i", &version, &count) != 2 || version != 1)
+		return false;
+	int set_values = 0;
+	if (count != dt_count_nodes(dec, &set_values))
+		return false;
+
+	return dt_profile_load_chain(dec, file);
+}
+
+
+static int
+dt_count_nodes(const struct decision *d, int *set_values)
+{
+	int count = 0;
+	for (; d; d=d->next) {
+		count++;
+		*set_values += d->set_size;
+		if (d->dest)
+			count += dt_count_nodes(d->dest, set_values);
+	}
+	return count;
+}
+
+/* Place the chain at nodes[*pos] ordered by hits, followed by the chains
+ * of its children, hottest first. Returns the head of the placed chain.
+ */
+static struct decision*
+dt_layout_chain(const struct decision *chain, struct decision *parent,
+				struct decision *nodes, int *pos, int **sets)
+{
+	int n = 0;
+	for (const struct decision *d = chain; d; d=d->next)
+		n++;
+
+	const struct decision **order;
+	order = (const struct decision**)malloc(sizeof(struct decision*) * n);
+
+	// Insertion sort keeps equally hot siblings in their original order
+	int i = 0;
+	for (const struct decision *d = chain; d; d=d->next, i++) {
+		int j = i;
+		while (j > 0 && order[j-1]->hits < d->hits) {
+			order[j] = order[j-1];
+			j--;
+		}
+		order[j] = d;
+	}
+
+	struct decision *head = &nodes[*pos];
+	*pos += n;
+
+	for (i=0; i<n; i++) {
+		head[i].field = order[i]->field;
+		head[i].value = order[i]->value;
+		head[i].hits = order[i]->hits;
+		head[i].samples = order[i]->samples;
+		head[i].agree = order[i]->agree;
+		head[i].parent = parent;
+		head[i].next = (i < n-1) ? &head[i+1] : NULL;
+
+		if (order[i]->set) {
+			head[i].set = *sets;
+			head[i].set_size = order[i]->set_size;
+			memcpy(*sets, order[i]->set, sizeof(int) * order[i]->set_size);
+			*sets += order[i]->set_size;
+		}
+	}
+
+	for (i=0; i<n; i++) {
+		if (order[i]->dest)
+			head[i].dest = dt_layout_chain(order[i]->dest, head, nodes,
+										   pos, sets);
+	}
+
+	free(order);
+	return head;
+}
+
+static void
+dt_profile_save_chain(const struct decision *d, FILE *file)
+{
+	for (; d; d=d->next) {
+		fprintf(file, "%lu\n", d->hits);
+		if (d->dest)
+			dt_profile_save_chain(d->dest, file);
+	}
+}
+
+static bool
+dt_profile_load_chain(struct decision *d, FILE *file)
+{
+	for (; d; d=d->next) {
+		if (fscanf(file, "%lu", &d->hits) != 1)
+			return false;
+		if (d->dest && !dt_profile_load_chain(d->dest, file))
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,34 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include "dtree.h"
+#include <stdio.h>
+
+
+/* Profile-guided layout
+ * dt_decide() scans every sibling chain linearly, in the order the
+ * values happened to appear in the training set. dt_decide_profile()
+ * records the number of visits of every node on a representative
+ * workload, and dt_relayout() uses the counts to put the most visited
+ * sibling first in each chain and the hottest paths next to each other.
+ */
+
+/* dt_decide() which counts the visit in "hits" of every node it takes.
+ */
+int dt_decide_profile(struct decision*, const struct sample*);
+
+/* Copy the tree into a single allocation, ordering every sibling chain
+ * by descending hits. The chains are laid out depth first, following the
+ * most visited branch first. The returned tree is flagged DT_FLAT and is
+ * released with dt_destroy().
+ */
+struct decision* dt_relayout(const struct decision*);
+
+/* Write the hit counts of the tree in the preorder of dt_save(), and
+ * assign them to a tree read with dt_load() from the matching model.
+ * dt_profile_load() returns false if the profile does not fit the tree.
+ */
+bool dt_profile_save(const struct decision*, FILE*);
+bool dt_profile_load(struct decision*, FILE*);
+
+#endif /* __PROFILE_H__ */
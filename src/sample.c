@@ -1,8 +1,10 @@
 #include "sample.h"
+#include "counts.h"
 #include <stdio.h>
 #include <malloc.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
 
 
 /* Where */
@@ -139,6 +141,53 @@ sample_print(const struct sample *sample)
 							field_value(sample, SAMPLE_RESULT_FIELD));
 }
 
+int
+sample_parse(struct sample *sample, const char *p, const char *end,
+			 const char **next)
+{
+	memset(sample, 0, sizeof(struct sample));
+
+	int field = 0;
+	bool malformed = false;
+	while (p < end && *p != '\n') {
+		if ((*p < '0' || *p > '9') && *p != '-') {
+			p++;
+			continue;
+		}
+
+		const bool neg = (*p == '-');
+		if (neg)
+			p++;
+		if (p == end || *p < '0' || *p > '9') {
+			malformed = true;
+			continue;
+		}
+
+		// Accumulate the magnitude in a long long, clamped to INT_MAX + 1
+		long long v = 0;
+		while (p < end && *p >= '0' && *p <= '9') {
+			if (v <= INT_MAX)
+				v = v * 10 + (*p - '0');
+			p++;
+		}
+
+		if (neg)
+			v = v > -(long long)INT_MIN ? INT_MIN : -v;
+		else if (v > INT_MAX)
+			v = INT_MAX;
+
+		if (field < SAMPLE_NUM_FIELDS)
+			set_field_value(sample, field, (int)v);
+		field++;
+	}
+
+	if (next)
+		*next = p < end ? p + 1 : end;
+	if (malformed)
+		return -1;
+	return field < SAMPLE_NUM_FIELDS ? field : SAMPLE_NUM_FIELDS;
+}
+
 double
 gini_impurity(const struct sample *samples, int count, unsigned field)
 {
@@ -163,45 +212,19 @@ gini_impurity(const struct sample *samples, int count, unsigned field)
 double 
 info_gain(const struct sample *samples, int count, unsigned field)
 {
-	const bool ig_print = false;
-
-
-	int unique;
-	int *vals = unique_values(samples, count, &unique, field);
-	int *occurs = (int*)malloc(sizeof(int) * unique);
-	for (int i=0; i<unique; i++)
-		occurs[i] = value_count(samples, count, vals[i], field);
-
-	double e = set_entropy(samples, count);
-	if (ig_print)
-		printf("Entropy(S, %i) = %g", field, e);
+	// Only the counts of the field and the result are needed
+	struct count_table t;
+	count_table_init(&t);
 
-	for (int i=0; i<unique; i++) {
-
-		struct where *where = where_alloc();
-		where->field = field;
-		where->value = vals[i];
-
-		int svcount = 0;
-		struct sample *sv = filter_where(samples, count, where, &svcount);
-
-		double se = set_entropy(sv, svcount);
-		double n = (double)occurs[i] / (double)count;
-		n *= se;
-		e -= n;
-
-		if (ig_print)
-			printf(" - (%i / %i) * %g", occurs[i], count, se);
-
-		where_destroy(where);
-		free(sv);
+	for (int i=0; i<count; i++) {
+		const int res = field_value(&samples[i], SAMPLE_RESULT_FIELD);
+		count_table_add(&t, SAMPLE_RESULT_FIELD, res, res, 1);
+		if (field != SAMPLE_RESULT_FIELD)
+			count_table_add(&t, field, field_value(&samples[i], field), res, 1);
 	}
 
-	if (ig_print)
-		printf(" = %g\n", e);
-
-	free(vals);
-	free(occurs);
+	double e = count_table_info_gain(&t, field);
+	count_table_free(&t);
 	return e;
 }
 
@@ -233,34 +256,15 @@ int*
 unique_values(const struct sample *samples, int count, 
 			  int *num_unique, unsigned field)
 {
-	// Each new found value is inserted into the keys array.
-	int *keys = (int*)malloc(sizeof(int)*6);
-	for (int i=0; i<6; i++) 
-		keys[i] = -1;
-
-	*num_unique = 0;
-
-	for (int i=0; i<count; i++) {
-		int k = field_value(&samples[i], field);
-
-		int j=0;
-		while (j < 6) {
-			if (keys[j] == -1) {
-				keys[j] = k;
-				(*num_unique)++;
-				break;
-			} else if (keys[j] == k) 
-				break;
-			j++;
-		}
-
-		if (j >= 6) {
-			printf(	"Sanitize your shit, we got 6 unique values\n"
-					"count: %i\nfield:%i\n", count, field);
-			break;
-		}
-	}
-
+	// The groups of a count_table are exactly the unique values, in
+	// order of first appearance.
+	struct count_table t;
+	count_table_init(&t);
+	for (int i=0; i<count; i++)
+		count_table_add(&t, field, field_value(&samples[i], field), 0, 1);
+
+	int *keys = count_table_values(&t, field, num_unique);
+	count_table_free(&t);
 	return keys;
 }
 
@@ -278,6 +282,14 @@ value_count(const struct sample *samples, int count, int value, unsigned field)
 	return occurrences;
 }
 
+int
+int_cmp(const void *a, const void *b)
+{
+	int x = *(const int*)a;
+	int y = *(const int*)b;
+	return (x > y) - (x < y);
+}
+
 int 
 field_value(const struct sample *sample, unsigned field)
 {
@@ -68,6 +68,19 @@ void sample_stats(const struct sample *samples, int count);
  */
 void sample_print(const struct sample *sample);
 
+/* Parse a sample from the line starting at [line], up to [end] or the
+ * first newline. The line holds up to SAMPLE_NUM_FIELDS integers,
+ * including the result, separated by any other characters; further
+ * integers are ignored and missing fields are 0. Values beyond the range
+ * of int are clamped to it. "next" is assigned the start of the next
+ * line, unless NULL.
+ *
+ * Returns the number of fields assigned, 0 for a line without any, or -1
+ * if the line is malformed: a '-' not followed by a digit.
+ */
+int sample_parse(struct sample*, const char *line, const char *end,
+				 const char **next);
+
 /* Calculate the gini impurity of field [field] for all the samples.
  */
 double gini_impurity(const struct sample *samples, int count, unsigned field);
@@ -90,6 +103,12 @@ int* unique_values(const struct sample*,int count,int *num_unique,unsigned field
  */
 int value_count(const struct sample*, int count, int value, unsigned field);
 
+/* Orders ints in ascending order, for qsort() and bsearch(). Records
+ * starting with an int key, such as (value, branch) pairs, are ordered by
+ * the key.
+ */
+int int_cmp(const void*, const void*);
+
 /* Returns the value of field[field].
  */
 int field_value(const struct sample*, unsigned field);
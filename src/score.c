@@ -0,0 +1,503 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "score.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+
+
+// Bytes read per chunk, and the number of chunks per thread in flight
+#define SCORE_CHUNK_SIZE	(1 << 20)
+#define SCORE_CHUNKS		4
+
+/* A chunk of whole input lines on its way through the pipeline. The
+ * buffers are reused once the writer is done with the chunk.
+ */
+struct chunk {
+	struct chunk *next;
+	long seq;
+
+	char *text;
+	int len;
+	int text_cap;
+
+	struct sample *rows;
+	int *results;
+	bool *invalid;		// Blank or malformed lines, decided as -1
+	int nrows;
+	int rows_cap;
+
+	char *output;
+	int output_len;
+};
+
+/* Blocking queue of chunks. Popping from an empty queue returns NULL
+ * once all producers are done.
+ */
+struct chunk_queue {
+	struct chunk *head;
+	struct chunk *tail;
+	int producers;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+struct score_job {
+	const struct decision *dec;
+	const struct dt_table *table;	// Decides instead of "dec" if set
+	struct dt_handle *handle;		// Decides instead of "dec" if set
+	dt_score_reload reload;
+	void *ctx;
+	FILE *in;
+	FILE *out;
+	bool error;			// Set by the reader and the writer
+	long rows;
+
+	struct chunk_queue free;
+	struct chunk_queue raw;
+	struct chunk_queue decoded;
+	struct chunk_queue scored;
+};
+
+/* A predictor thread, and its reader of the handle */
+struct score_predictor {
+	struct score_job *job;
+	struct dt_reader *reader;
+	pthread_t thread;
+};
+
+static long score_file(struct score_job*, const char *in, const char *out,
+					   int threads);
+static void* score_reader(void*);
+static void* score_decoder(void*);
+static void* score_predictor(void*);
+static void score_writer(struct score_job*);
+
+static int decode_chunk(struct chunk*);
+static void format_results(struct chunk*);
+
+static void queue_init(struct chunk_queue*, int producers);
+static void queue_destroy(struct chunk_queue*);
+static void queue_push(struct chunk_queue*, struct chunk*);
+static struct chunk* queue_pop(struct chunk_queue*);
+static void queue_done(struct chunk_queue*);
+
+
+
+long
+dt_score_file(const struct decision *dec, const char *in, const char *out,
+			  int threads)
+{
+	struct score_job job;
+	memset(&job, 0, sizeof(job));
+	job.dec = dec;
+	return score_file(&job, in, out, threads);
+}
+
+long
+dt_score_table_file(const struct dt_table *table, const char *in,
+					const char *out, int threads)
+{
+	struct score_job job;
+	memset(&job, 0, sizeof(job));
+	job.dec = table->tree;
+	job.table = table;
+	return score_file(&job, in, out, threads);
+}
+
+long
+dt_score_handle_file(struct dt_handle *handle, const char *in, const char *out,
+					 int threads, dt_score_reload reload, void *ctx)
+{
+	struct score_job job;
+	memset(&job, 0, sizeof(job));
+	job.handle = handle;
+	job.reload = reload;
+	job.ctx = ctx;
+	return score_file(&job, in, out, threads);
+}
+
+
+static long
+score_file(struct score_job *job, const char *in, const char *out, int threads)
+{
+	if (threads < 1)
+		threads = 1;
+
+	job->in = fopen(in, "rb");
+	if (!job->in) {
+		printf("ERROR: unable to open %s\n", in);
+		return -1;
+	}
+
+	job->out = fopen(out, "wb");
+	if (!job->out) {
+		printf("ERROR: unable to open %s\n", out);
+		fclose(job->in);
+		return -1;
+	}
+
+	// Predictors deciding through the handle have a reader each
+	struct score_predictor *predictors;
+	predictors = (struct score_predictor*)malloc(sizeof(struct score_predictor)
+												 * threads);
+	memset(predictors, 0, sizeof(struct score_predictor) * threads);
+	bool registered = true;
+	for (int i=0; i<threads; i++) {
+		predictors[i].job = job;
+		if (job->handle) {
+			predictors[i].reader = dt_handle_reader(job->handle);
+			registered = registered && predictors[i].reader;
+		}
+	}
+
+	if (!registered) {
+		printf("ERROR: unable to register the readers of the model\n");
+		for (int i=0; i<threads; i++) {
+			if (predictors[i].reader)
+				dt_reader_release(predictors[i].reader);
+		}
+		free(predictors);
+		fclose(job->out);
+		fclose(job->in);
+		return -1;
+	}
+
+	queue_init(&job->free, 1);
+	queue_init(&job->raw, 1);
+	queue_init(&job->decoded, threads);
+	queue_init(&job->scored, threads);
+
+	const int nchunks = SCORE_CHUNKS * (threads + 1);
+	struct chunk *chunks = (struct chunk*)malloc(sizeof(struct chunk) * nchunks);
+	memset(chunks, 0, sizeof(struct chunk) * nchunks);
+	for (int i=0; i<nchunks; i++) {
+		chunks[i].text_cap = SCORE_CHUNK_SIZE;
+		chunks[i].text = (char*)malloc(SCORE_CHUNK_SIZE);
+		queue_push(&job->free, &chunks[i]);
+	}
+
+	pthread_t reader;
+	pthread_t *decoders = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+
+	pthread_create(&reader, NULL, score_reader, job);
+	for (int i=0; i<threads; i++) {
+		pthread_create(&decoders[i], NULL, score_decoder, job);
+		pthread_create(&predictors[i].thread, NULL, score_predictor,
+					   &predictors[i]);
+	}
+
+	score_writer(job);
+
+	pthread_join(reader, NULL);
+	for (int i=0; i<threads; i++) {
+		pthread_join(decoders[i], NULL);
+		pthread_join(predictors[i].thread, NULL);
+		if (predictors[i].reader)
+			dt_reader_release(predictors[i].reader);
+	}
+
+	if (fclose(job->out) != 0)
+		job->error = true;
+	fclose(job->in);
+
+	for (int i=0; i<nchunks; i++) {
+		free(chunks[i].text);
+		free(chunks[i].rows);
+		free(chunks[i].results);
+		free(chunks[i].invalid);
+		free(chunks[i].output);
+	}
+	free(chunks);
+	free(decoders);
+	free(predictors);
+
+	queue_destroy(&job->free);
+	queue_destroy(&job->raw);
+	queue_destroy(&job->decoded);
+	queue_destroy(&job->scored);
+
+	if (job->error) {
+		printf("ERROR: scoring %s into %s failed\n", in, out);
+		return -1;
+	}
+
+	return job->rows;
+}
+
+
+/** Pipeline stages **/
+static void*
+score_reader(void *arg)
+{
+	struct score_job *job = (struct score_job*)arg;
+
+	// Bytes of the last, incomplete line of the previous chunk
+	char *carry = NULL;
+	int ncarry = 0;
+	long seq = 0;
+	bool eof = false;
+
+	while (!eof) {
+		struct chunk *c = queue_pop(&job->free);
+		if (!c)
+			break;
+
+		// Chunks read from now on are decided by the reloaded model
+		if (job->reload)
+			job->reload(job->handle, job->ctx);
+
+		if (ncarry > c->text_cap) {
+			c->text_cap = ncarry * 2;
+			c->text = (char*)realloc(c->text, c->text_cap);
+		}
+		if (ncarry > 0)
+			memcpy(c->text, carry, ncarry);
+		int len = ncarry;
+		ncarry = 0;
+
+		// Fill the chunk and cut it after the last complete line. Lines
+		// longer than a chunk grow the buffer.
+		while (true) {
+			size_t n = fread(c->text + len, 1, c->text_cap - len, job->in);
+			len += n;
+			if (n == 0) {
+				eof = true;
+				if (ferror(job->in))
+					__atomic_store_n(&job->error, true, __ATOMIC_RELAXED);
+			}
+
+			int end = len;
+			while (end > 0 && c->text[end-1] != '\n')
+				end--;
+
+			if (end > 0 || eof) {
+				c->len = end > 0 && !eof ? end : len;
+				ncarry = len - c->len;
+				break;
+			}
+
+			if (len == c->text_cap) {
+				c->text_cap *= 2;
+				c->text = (char*)realloc(c->text, c->text_cap);
+			}
+		}
+
+		if (ncarry > 0) {
+			carry = (char*)realloc(carry, ncarry);
+			memcpy(carry, c->text + c->len, ncarry);
+		}
+
+		if (c->len == 0) {
+			queue_push(&job->free, c);
+			break;
+		}
+
+		c->seq = seq++;
+		queue_push(&job->raw, c);
+	}
+
+	free(carry);
+	queue_done(&job->raw);
+	return NULL;
+}
+
+static void*
+score_decoder(void *arg)
+{
+	struct score_job *job = (struct score_job*)arg;
+	struct chunk *c;
+
+	while ((c = queue_pop(&job->raw))) {
+		decode_chunk(c);
+		queue_push(&job->decoded, c);
+	}
+
+	queue_done(&job->decoded);
+	return NULL;
+}
+
+static void*
+score_predictor(void *arg)
+{
+	struct score_predictor *p = (struct score_predictor*)arg;
+	struct score_job *job = p->job;
+	struct chunk *c;
+
+	while ((c = queue_pop(&job->decoded))) {
+		if (job->table)
+			dt_table_decide_batch(job->table, c->rows, c->nrows, c->results);
+		else if (p->reader)
+			dt_handle_decide_batch(p->reader, c->rows, c->nrows, c->results);
+		else
+			dt_decide_batch(job->dec, c->rows, c->nrows, c->results);
+		format_results(c);
+		queue_push(&job->scored, c);
+	}
+
+	queue_done(&job->scored);
+	return NULL;
+}
+
+static void
+score_writer(struct score_job *job)
+{
+	// Chunks finishing out of order wait here until it is their turn
+	struct chunk *pending = NULL;
+	long next = 0;
+
+	while (true) {
+		struct chunk **p = &pending;
+		while (*p && (*p)->seq != next)
+			p = &(*p)->next;
+
+		if (!*p) {
+			struct chunk *c = queue_pop(&job->scored);
+			if (!c)
+				break;
+			c->next = pending;
+			pending = c;
+			continue;
+		}
+
+		struct chunk *c = *p;
+		*p = c->next;
+
+		if (fwrite(c->output, 1, c->output_len, job->out) != (size_t)c->output_len)
+			__atomic_store_n(&job->error, true, __ATOMIC_RELAXED);
+		job->rows += c->nrows;
+		next++;
+
+		queue_push(&job->free, c);
+	}
+
+	queue_done(&job->free);
+}
+
+
+/** Decoding and formatting **/
+static int
+decode_chunk(struct chunk *c)
+{
+	int lines = 1;
+	for (int i=0; i<c->len; i++) {
+		if (c->text[i] == '\n')
+			lines++;
+	}
+
+	if (lines > c->rows_cap) {
+		c->rows_cap = lines;
+		c->rows = (struct sample*)realloc(c->rows, sizeof(struct sample) * lines);
+		c->results = (int*)realloc(c->results, sizeof(int) * lines);
+		c->invalid = (bool*)realloc(c->invalid, sizeof(bool) * lines);
+	}
+
+	c->nrows = 0;
+	const char *p = c->text;
+	const char *end = c->text + c->len;
+
+	while (p < end) {
+		struct sample *s = &c->rows[c->nrows];
+
+		// Blank and malformed lines keep their row, so that decision N is
+		// that of line N
+		c->invalid[c->nrows] = sample_parse(s, p, end, &p) <= 0;
+		c->nrows++;
+	}
+
+	return c->nrows;
+}
+
+static void
+format_results(struct chunk *c)
+{
+	// "-2147483648\n" is the longest decision
+	c->output = (char*)realloc(c->output, 12 * (c->nrows + 1));
+
+	char *o = c->output;
+	for (int i=0; i<c->nrows; i++) {
+		if (c->invalid[i])
+			c->results[i] = -1;
+
+		unsigned v = c->results[i];
+		if (c->results[i] < 0) {
+			*o++ = '-';
+			v = -(unsigned)c->results[i];
+		}
+
+		char digits[10];
+		int n = 0;
+		do {
+			digits[n++] = '0' + v % 10;
+			v /= 10;
+		} while (v);
+
+		while (n)
+			*o++ = digits[--n];
+		*o++ = '\n';
+	}
+
+	c->output_len = o - c->output;
+}
+
+
+/** chunk_queue **/
+static void
+queue_init(struct chunk_queue *q, int producers)
+{
+	q->head = NULL;
+	q->tail = NULL;
+	q->producers = producers;
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->cond, NULL);
+}
+
+static void
+queue_destroy(struct chunk_queue *q)
+{
+	pthread_mutex_destroy(&q->lock);
+	pthread_cond_destroy(&q->cond);
+}
+
+static void
+queue_push(struct chunk_queue *q, struct chunk *c)
+{
+	c->next = NULL;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->tail)
+		q->tail->next = c;
+	else
+		q->head = c;
+	q->tail = c;
+	pthread_cond_signal(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+}
+
+static struct chunk*
+queue_pop(struct chunk_queue *q)
+{
+	pthread_mutex_lock(&q->lock);
+	while (!q->head && q->producers > 0)
+		pthread_cond_wait(&q->cond, &q->lock);
+
+	struct chunk *c = q->head;
+	if (c) {
+		q->head = c->next;
+		if (!q->head)
+			q->tail = NULL;
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	return c;
+}
+
+static void
+queue_done(struct chunk_queue *q)
+{
+	pthread_mutex_lock(&q->lock);
+	q->producers--;
+	pthread_cond_broadcast(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+}
@@ -0,0 +1,49 @@
+#ifndef __SCORE_H__
+#define __SCORE_H__
+
+#include "dtree.h"
+#include "table.h"
+#include "handle.h"
+
+
+/* Bulk scoring
+ * The input is streamed through a pipeline of bounded stages:
+ *
+ *	reader -> decoders -> predictors -> writer
+ *
+ * The reader splits the file into chunks of whole lines, decoder threads
+ * parse the chunks into batches of samples, predictor threads run
+ * dt_decide_batch() on them and the writer emits the decisions in input
+ * order. The number of chunks in flight is fixed, so memory use does not
+ * depend on the size of the input.
+ *
+ * Each input line holds the fields of one sample, as read by
+ * sample_parse(). One decision is written per line, -1 for lines without
+ * any field and for malformed lines.
+ */
+
+/* Score the file [in] into [out] using [threads] decoder and [threads]
+ * predictor threads. Returns the number of scored rows, or -1 on error.
+ */
+long dt_score_file(const struct decision*, const char *in, const char *out,
+				   int threads);
+
+// dt_score_file() deciding by a compiled table (see src/table.h)
+long dt_score_table_file(const struct dt_table*, const char *in,
+						 const char *out, int threads);
+
+/* Called by the reader before each chunk, and may publish a new tree to
+ * the handle.
+ */
+typedef void (*dt_score_reload)(struct dt_handle*, void *ctx);
+
+/* dt_score_file() deciding by the current tree of a handle (see
+ * src/handle.h), so that the model can be replaced while scoring. Each
+ * predictor thread is a reader of the handle, and every chunk is decided
+ * by a single tree. Unless [reload] is NULL, it is called with [ctx]
+ * before each chunk is read.
+ */
+long dt_score_handle_file(struct dt_handle*, const char *in, const char *out,
+						  int threads, dt_score_reload reload, void *ctx);
+
+#endif /* __SCORE_H__ */
@@ -0,0 +1,408 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "shard.h"
+#include "counts.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+
+enum shard_op {
+	SHARD_OP_COUNT,
+	SHARD_OP_SPLIT,
+	SHARD_OP_QUIT,
+};
+
+/* A node in the frontier. The chain of branches or the leaf chosen for
+ * the node is written to "slot".
+ */
+struct shard_node {
+	struct decision **slot;
+	struct decision *parent;
+	unsigned used;			// Bitmask of the fields used on the path
+	int depth;
+};
+
+/* Growable int buffer holding a message */
+struct shard_msg {
+	int size;
+	int cap;
+	int *d;
+};
+
+struct shard_slice {
+	const struct sample *samples;
+	int count;
+};
+
+static void shard_worker(int fd, struct sample *rows, int count);
+static void shard_split_node(struct shard_node*, const struct count_table*,
+							 const struct dt_params*,
+							 struct shard_node **next, int *nnext,
+							 struct shard_msg*);
+static struct sample* shard_slice_loader(int, int, int*, void*);
+
+static void shard_msg_push(struct shard_msg*, int);
+static bool write_all(int fd, const void *buf, size_t sz);
+static bool read_all(int fd, void *buf, size_t sz);
+
+
+
+struct decision*
+dt_create_sharded(shard_loader loader, void *ctx, int nshards,
+				  const struct dt_params *params)
+{
+	int *fds = (int*)malloc(sizeof(int) * nshards);
+	pid_t *pids = (pid_t*)malloc(sizeof(pid_t) * nshards);
+	int started = 0;
+
+	struct decision *root = NULL;
+	bool error = false;
+
+	for (; started<nshards; started++) {
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+			perror("socketpair");
+			error = true;
+			break;
+		}
+
+		pid_t pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			close(sv[0]);
+			close(sv[1]);
+			error = true;
+			break;
+		}
+
+		if (pid == 0) {
+			// The worker only talks to the coordinator
+			for (int i=0; i<started; i++)
+				close(fds[i]);
+			close(sv[0]);
+
+			int count = 0;
+			struct sample *rows = loader(started, nshards, &count, ctx);
+			shard_worker(sv[1], rows, count);
+			_exit(0);
+		}
+
+		close(sv[1]);
+		fds[started] = sv[0];
+		pids[started] = pid;
+	}
+
+	struct shard_node *frontier = NULL;
+	int nfrontier = 0;
+	struct count_table tmp;
+	count_table_init(&tmp);
+
+	if (!error) {
+		frontier = (struct shard_node*)malloc(sizeof(struct shard_node));
+		frontier[0].slot = &root;
+		frontier[0].parent = NULL;
+		frontier[0].used = 0;
+		frontier[0].depth = 0;
+		nfrontier = 1;
+	}
+
+	while (!error && nfrontier > 0) {
+		// Gather and merge the count tables of every shard
+		struct count_table *tables;
+		tables = (struct count_table*)malloc(sizeof(struct count_table) * nfrontier);
+		for (int i=0; i<nfrontier; i++)
+			count_table_init(&tables[i]);
+
+		int op[2] = { SHARD_OP_COUNT, nfrontier };
+		for (int s=0; s<nshards && !error; s++)
+			error = !write_all(fds[s], op, sizeof(op));
+
+		for (int s=0; s<nshards && !error; s++) {
+			for (int i=0; i<nfrontier && !error; i++) {
+				int size = 0;
+				if (!read_all(fds[s], &size, sizeof(int))) {
+					error = true;
+					break;
+				}
+
+				count_table_clear(&tmp);
+				for (int j=0; j<size; j++) {
+					struct count_entry e;
+					if (!read_all(fds[s], &e, sizeof(e))) {
+						error = true;
+						break;
+					}
+					count_table_add(&tmp, e.field, e.value, e.result, e.count);
+				}
+				count_table_merge(&tables[i], &tmp);
+			}
+		}
+
+		// Choose the splits and broadcast them
+		struct shard_node *next = NULL;
+		int nnext = 0;
+		struct shard_msg msg;
+		memset(&msg, 0, sizeof(msg));
+		shard_msg_push(&msg, SHARD_OP_SPLIT);
+		shard_msg_push(&msg, nfrontier);
+
+		for (int i=0; i<nfrontier && !error; i++)
+			shard_split_node(&frontier[i], &tables[i], params, &next, &nnext,
+							 &msg);
+
+		for (int s=0; s<nshards && !error; s++)
+			error = !write_all(fds[s], msg.d, sizeof(int) * msg.size);
+
+		for (int i=0; i<nfrontier; i++)
+			count_table_free(&tables[i]);
+		free(tables);
+		free(msg.d);
+
+		free(frontier);
+		frontier = next;
+		nfrontier = nnext;
+	}
+
+	if (error)
+		printf("ERROR: sharded training failed, a worker died\n");
+
+	int quit[2] = { SHARD_OP_QUIT, 0 };
+	for (int s=0; s<started; s++) {
+		write_all(fds[s], quit, sizeof(quit));
+		close(fds[s]);
+		waitpid(pids[s], NULL, 0);
+	}
+
+	count_table_free(&tmp);
+	free(frontier);
+	free(fds);
+	free(pids);
+
+	if (error && root) {
+		dt_destroy(root);
+		root = NULL;
+	}
+
+	return root;
+}
+
+struct decision*
+dt_create_sharded_samples(const struct sample *samples, int count, int nshards,
+						  const struct dt_params *params)
+{
+	struct shard_slice slice;
+	slice.samples = samples;
+	slice.count = count;
+	return dt_create_sharded(shard_slice_loader, &slice, nshards, params);
+}
+
+
+/* Worker
+ * Every row is assigned to a node in the frontier, or -1 once the row
+ * has reached a leaf.
+ */
+static void
+shard_worker(int fd, struct sample *rows, int count)
+{
+	int *node = (int*)malloc(sizeof(int) * (count + 1));
+	for (int i=0; i<count; i++)
+		node[i] = 0;
+
+	struct count_table *tables = NULL;
+	int ntables = 0;
+
+	while (true) {
+		int op[2];
+		if (!read_all(fd, op, sizeof(op)) || op[0] == SHARD_OP_QUIT)
+			break;
+
+		const int nfrontier = op[1];
+
+		if (op[0] == SHARD_OP_COUNT) {
+			if (nfrontier > ntables) {
+				int sz = sizeof(struct count_table) * nfrontier;
+				tables = (struct count_table*)realloc(tables, sz);
+				for (int i=ntables; i<nfrontier; i++)
+					count_table_init(&tables[i]);
+				ntables = nfrontier;
+			}
+
+			for (int i=0; i<nfrontier; i++)
+				count_table_clear(&tables[i]);
+			for (int i=0; i<count; i++) {
+				if (node[i] >= 0)
+					count_table_add_sample(&tables[node[i]], &rows[i]);
+			}
+
+			for (int i=0; i<nfrontier; i++) {
+				const struct count_table *t = &tables[i];
+				if (!write_all(fd, &t->size, sizeof(int)) ||
+					!write_all(fd, t->e, sizeof(struct count_entry) * t->size))
+					goto shard_worker_cleanup;
+			}
+		} else if (op[0] == SHARD_OP_SPLIT) {
+			// For each node: field (-1 for leaves), the number of
+			// pairs and a (value, child node) pair for every value of
+			// the children, sorted by value.
+			int **child = (int**)malloc(sizeof(int*) * (nfrontier + 1));
+			int *field = (int*)malloc(sizeof(int) * (nfrontier + 1));
+			int *nchild = (int*)malloc(sizeof(int) * (nfrontier + 1));
+
+			bool ok = true;
+			for (int i=0; i<nfrontier; i++) {
+				int hdr[2] = { -1, 0 };
+				if (ok)
+					ok = read_all(fd, hdr, sizeof(hdr));
+				field[i] = hdr[0];
+				nchild[i] = hdr[1];
+				child[i] = (int*)malloc(sizeof(int) * 2 * (nchild[i] + 1));
+				if (ok)
+					ok = read_all(fd, child[i], sizeof(int) * 2 * nchild[i]);
+			}
+
+			for (int i=0; ok && i<count; i++) {
+				const int n = node[i];
+				if (n < 0)
+					continue;
+
+				node[i] = -1;
+				if (field[n] < 0)
+					continue;
+
+				const int v = field_value(&rows[i], field[n]);
+				node[i] = dt_pair_find(child[n], nchild[n], v);
+			}
+
+			for (int i=0; i<nfrontier; i++)
+				free(child[i]);
+			free(child);
+			free(field);
+			free(nchild);
+
+			if (!ok)
+				break;
+		}
+	}
+
+shard_worker_cleanup:
+	for (int i=0; i<ntables; i++)
+		count_table_free(&tables[i]);
+	free(tables);
+	free(node);
+	close(fd);
+}
+
+
+/* Coordinator
+ * Decide the fate of one frontier node with dt_split_node(). Children are
+ * appended to "next" and the decision is appended to "msg".
+ */
+static void
+shard_split_node(struct shard_node *node, const struct count_table *t,
+				 const struct dt_params *params, struct shard_node **next,
+				 int *nnext, struct shard_msg *msg)
+{
+	bool excluded[SAMPLE_NUM_FIELDS];
+	for (int i=0; i<SAMPLE_NUM_FIELDS; i++)
+		excluded[i] = (node->used & (1u << i)) != 0;
+
+	int nchild = 0;
+	struct decision *dec = dt_split_node(t, excluded, node->depth, params,
+										 &nchild);
+	for (struct decision *d = dec; d; d=d->next)
+		d->parent = node->parent;
+	*node->slot = dec;
+
+	if (nchild == 0) {
+		shard_msg_push(msg, -1);
+		shard_msg_push(msg, 0);
+		return;
+	}
+
+	int npairs = 0;
+	int *pairs = dt_split_pairs(dec, &npairs);
+	shard_msg_push(msg, dec->field);
+	shard_msg_push(msg, npairs);
+	for (int i=0; i<npairs; i++) {
+		shard_msg_push(msg, pairs[2*i]);
+		shard_msg_push(msg, *nnext + pairs[2*i+1]);
+	}
+	free(pairs);
+
+	// Subsets leave the field available, like dt_split_subset
+	const unsigned used = dec->set ? node->used : node->used | (1u << dec->field);
+
+	int sz = sizeof(struct shard_node) * (*nnext + nchild);
+	*next = (struct shard_node*)realloc(*next, sz);
+	for (struct decision *d = dec; d; d=d->next) {
+		struct shard_node *c = &(*next)[(*nnext)++];
+		c->slot = &d->dest;
+		c->parent = dec;
+		c->used = used;
+		c->depth = node->depth + 1;
+	}
+}
+
+static struct sample*
+shard_slice_loader(int shard, int nshards, int *count, void *ctx)
+{
+	const struct shard_slice *slice = (const struct shard_slice*)ctx;
+	const int begin = (int)((long)slice->count * shard / nshards);
+	const int end = (int)((long)slice->count * (shard + 1) / nshards);
+
+	*count = end - begin;
+	return (struct sample*)(slice->samples + begin);
+}
+
+
+/** I/O **/
+static void
+shard_msg_push(struct shard_msg *msg, int val)
+{
+	if (msg->size == msg->cap) {
+		msg->cap = msg->cap ? msg->cap * 2 : 64;
+		msg->d = (int*)realloc(msg->d, sizeof(int) * msg->cap);
+	}
+	msg->d[msg->size++] = val;
+}
+
+/* Writes to a dead peer fail with EPIPE instead of raising SIGPIPE, so
+ * that a crashed worker is reported rather than killing the coordinator.
+ */
+static bool
+write_all(int fd, const void *buf, size_t sz)
+{
+	const char *p = (const char*)buf;
+	while (sz > 0) {
+		ssize_t n = send(fd, p, sz, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		sz -= n;
+	}
+	return true;
+}
+
+static bool
+read_all(int fd, void *buf, size_t sz)
+{
+	char *p = (char*)buf;
+	while (sz > 0) {
+		ssize_t n = read(fd, p, sz);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		sz -= n;
+	}
+	return true;
+}
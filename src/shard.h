@@ -0,0 +1,43 @@
+#ifndef __SHARD_H__
+#define __SHARD_H__
+
+#include "sample.h"
+#include "dtree.h"
+
+
+/* Sharded training
+ * The tree is grown one level at a time. Each worker process owns one
+ * shard of the rows and counts the current frontier into a count_table
+ * per node. The coordinator merges the tables, chooses the splits exactly
+ * like dt_parse_samples and sends them back to the workers, which move
+ * their rows to the child nodes. Only count tables and split decisions
+ * cross the process boundary, so no single process has to hold all rows.
+ *
+ * Workers are forked processes talking to the coordinator over Unix
+ * socket pairs.
+ */
+
+/* Returns the rows of shard [shard] out of [nshards] and assigns the
+ * number of rows to "count". The function is called in the worker
+ * process, which owns the returned rows.
+ */
+typedef struct sample* (*shard_loader)(int shard, int nshards,
+									   int *count, void *ctx);
+
+/* Train a tree with the configuration [params] on [nshards] workers
+ * getting their rows from [loader]. The tree equals the one
+ * dt_create_params() trains on all rows; the cache, lazy growth and
+ * out-of-core fields of the configuration do not apply. NULL is returned
+ * if the workers could not be started or died.
+ */
+struct decision* dt_create_sharded(shard_loader loader, void *ctx, int nshards,
+								   const struct dt_params *params);
+
+/* Train a tree on an in-memory set, split into [nshards] contiguous
+ * ranges. The workers share the set with the coordinator through fork().
+ */
+struct decision* dt_create_sharded_samples(const struct sample*, int count,
+										   int nshards,
+										   const struct dt_params *params);
+
+#endif /* __SHARD_H__ */
@@ -0,0 +1,619 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "spill.h"
+#include "counts.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+
+
+// Fields stored for every row, including "id"
+#define SPILL_COLUMNS	((int)(sizeof(struct sample) / sizeof(int)))
+
+// Upper bound of the encoded size of a row
+#define SPILL_ROW_BYTES	(SPILL_COLUMNS * 5)
+
+#define SPILL_BLOCK_MIN	64
+#define SPILL_BLOCK_MAX	65536
+
+// Children written in one pass over the rows of a node
+#define SPILL_MAX_OPEN	64
+
+struct spill_job {
+	const struct dt_params *params;
+	const char *dir;
+	int block_rows;
+	long seq;
+	bool error;
+	long malformed;			// Line of the first malformed sample, or 0
+	unsigned char *raw;		// Encoding buffer of the writers
+};
+
+/* Reads the blocks of a spill file on a thread of its own, into two
+ * buffers used in turn. The consumer holds one while the other is read.
+ */
+struct spill_reader {
+	const struct spill_job *job;
+	FILE *file;
+	struct sample *rows[2];
+	int count[2];
+	bool full[2];
+	int cur;
+	bool held;
+	bool eof;
+	bool error;
+	bool stop;
+	unsigned char *raw;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+};
+
+struct spill_writer {
+	FILE *file;
+	struct sample *rows;
+	int count;
+};
+
+static struct decision* spill_node(struct spill_job*, const char *path,
+								   long count, struct where*, int depth);
+static bool spill_import(struct spill_job*, FILE *in, const char *path,
+						 long *count);
+static struct sample* spill_load(struct spill_job*, const char *path,
+								 long count);
+static bool spill_count(struct spill_job*, const char *path,
+						struct count_table*);
+static bool spill_partition(struct spill_job*, const char *path,
+							unsigned field, const int *pairs, int npairs,
+							int nchild, char **paths, long *counts);
+static char* spill_path(struct spill_job*);
+
+static bool spill_reader_open(struct spill_reader*, const struct spill_job*,
+							  const char *path);
+static const struct sample* spill_reader_next(struct spill_reader*, int *count);
+static bool spill_reader_close(struct spill_reader*);
+static void* spill_reader_main(void*);
+
+static bool spill_writer_add(struct spill_job*, struct spill_writer*,
+							 const struct sample*);
+static bool spill_writer_flush(struct spill_job*, struct spill_writer*);
+
+static int spill_encode(const struct sample*, int count, bool compress,
+						unsigned char *out);
+static bool spill_decode(const unsigned char *in, int bytes, int count,
+						 bool compress, struct sample*);
+
+
+
+struct decision*
+dt_create_spilled(const char *path, const struct dt_params *params)
+{
+	FILE *in = fopen(path, "r");
+	if (!in) {
+		printf("ERROR: unable to open %s\n", path);
+		return NULL;
+	}
+
+	struct spill_job job;
+	memset(&job, 0, sizeof(job));
+	job.params = params;
+	job.dir = params->spill_dir;
+	if (!job.dir)
+		job.dir = getenv("TMPDIR");
+	if (!job.dir)
+		job.dir = "/tmp";
+
+	// Blocks take at most half of the budget: the buffers of the reader
+	// and of every open child.
+	const long row = sizeof(struct sample) * (SPILL_MAX_OPEN + 2)
+					 + 2 * SPILL_ROW_BYTES;
+	long rows = params->memory / 2 / row;
+	if (rows < SPILL_BLOCK_MIN)	rows = SPILL_BLOCK_MIN;
+	if (rows > SPILL_BLOCK_MAX)	rows = SPILL_BLOCK_MAX;
+	job.block_rows = (int)rows;
+	job.raw = (unsigned char*)malloc(SPILL_ROW_BYTES * job.block_rows);
+
+	char *root = spill_path(&job);
+	long count = 0;
+	bool ok = spill_import(&job, in, root, &count);
+	fclose(in);
+
+	struct decision *dec = NULL;
+	if (ok && count > 0)
+		dec = spill_node(&job, root, count, NULL, 0);
+	else
+		unlink(root);
+
+	if (job.malformed)
+		printf("ERROR: %s holds a malformed sample on line %li\n", path,
+			   job.malformed);
+	else if (ok && count == 0)
+		printf("ERROR: %s holds no samples\n", path);
+	else if (!ok || job.error)
+		printf("ERROR: out-of-core training failed, unable to use %s\n",
+			   job.dir);
+
+	if ((!ok || job.error) && dec) {
+		dt_destroy(dec);
+		dec = NULL;
+	}
+
+	free(root);
+	free(job.raw);
+	return dec;
+}
+
+
+/** Training **/
+/* Train the subtree of the rows in the spill file [path], and remove the
+ * file. Nodes are split by dt_split_node().
+ */
+static struct decision*
+spill_node(struct spill_job *job, const char *path, long count,
+		   struct where *where, int depth)
+{
+	const struct dt_params *params = job->params;
+
+	if (count * (long)sizeof(struct sample) <= params->memory / 4) {
+		struct sample *rows = spill_load(job, path, count);
+		unlink(path);
+		if (!rows) {
+			job->error = true;
+			return NULL;
+		}
+
+		struct decision *dec;
+		dec = dt_create_subtree(rows, (int)count, where, depth, params);
+		free(rows);
+		return dec;
+	}
+
+	struct count_table t;
+	count_table_init(&t);
+	if (!spill_count(job, path, &t)) {
+		count_table_free(&t);
+		unlink(path);
+		job->error = true;
+		return NULL;
+	}
+
+	bool excluded[SAMPLE_NUM_FIELDS];
+	for (int i=0; i<SAMPLE_NUM_FIELDS; i++)
+		excluded[i] = is_field_clausule(where, i);
+
+	int nchild = 0;
+	struct decision *dec = dt_split_node(&t, excluded, depth, params, &nchild);
+	count_table_free(&t);
+	if (nchild == 0) {
+		unlink(path);
+		return dec;
+	}
+
+	const unsigned best = dec->field;
+	const bool subset = dec->set != NULL;
+
+	// Map every value of the field to its child
+	int npairs = 0;
+	int *pairs = dt_split_pairs(dec, &npairs);
+
+	char **paths = (char**)malloc(sizeof(char*) * nchild);
+	long *counts = (long*)malloc(sizeof(long) * nchild);
+	for (int i=0; i<nchild; i++) {
+		paths[i] = spill_path(job);
+		counts[i] = 0;
+	}
+
+	bool ok = spill_partition(job, path, best, pairs, npairs, nchild,
+							  paths, counts);
+	unlink(path);
+	free(pairs);
+	if (!ok)
+		job->error = true;
+
+	// Subsets leave the field available, like dt_split_subset
+	struct where *w = NULL;
+	if (!subset) {
+		w = where_alloc();
+		w->field = best;
+		if (where)	where_append(where, w);
+		else		where = w;
+	}
+
+	int c = 0;
+	for (struct decision *d = dec; d; d=d->next, c++) {
+		if (!job->error) {
+			if (w)
+				w->value = d->value;
+			d->dest = spill_node(job, paths[c], counts[c], where, depth+1);
+			for (struct decision *sub = d->dest; sub; sub=sub->next)
+				sub->parent = dec;
+		} else {
+			unlink(paths[c]);
+		}
+		free(paths[c]);
+	}
+
+	if (w) {
+		if (where != w)
+			where_destroy(where_pop(where));
+		else
+			where_destroy(w);
+	}
+
+	free(paths);
+	free(counts);
+	return dec;
+}
+
+
+/** Passes over the rows **/
+/* Write the samples of the text file [in] to the spill file [path],
+ * numbering them from 1 in "id".
+ */
+static bool
+spill_import(struct spill_job *job, FILE *in, const char *path, long *count)
+{
+	struct spill_writer w;
+	w.file = fopen(path, "w");
+	if (!w.file)
+		return false;
+	w.rows = (struct sample*)malloc(sizeof(struct sample) * job->block_rows);
+	w.count = 0;
+
+	char *line = NULL;
+	size_t cap = 0;
+	bool ok = true;
+
+	long lineno = 0;
+	ssize_t len;
+	while (ok && (len = getline(&line, &cap, in)) > 0) {
+		lineno++;
+		struct sample s;
+		const int fields = sample_parse(&s, line, line + len, NULL);
+		if (fields < 0) {
+			job->malformed = lineno;
+			ok = false;
+			break;
+		}
+
+		if (fields == 0)
+			continue;
+		s.id = (int)++*count;
+		ok = spill_writer_add(job, &w, &s);
+	}
+
+	ok = ok && !ferror(in) && spill_writer_flush(job, &w);
+	ok = (fclose(w.file) == 0) && ok;
+	free(w.rows);
+	free(line);
+	return ok;
+}
+
+static struct sample*
+spill_load(struct spill_job *job, const char *path, long count)
+{
+	struct spill_reader r;
+	if (!spill_reader_open(&r, job, path))
+		return NULL;
+
+	struct sample *rows = (struct sample*)malloc(sizeof(struct sample) * count);
+	long n = 0;
+	const struct sample *block;
+	int size = 0;
+	while ((block = spill_reader_next(&r, &size))) {
+		if (n + size > count)
+			break;
+		memcpy(rows + n, block, sizeof(struct sample) * size);
+		n += size;
+	}
+
+	if (!spill_reader_close(&r) || n != count) {
+		free(rows);
+		return NULL;
+	}
+	return rows;
+}
+
+static bool
+spill_count(struct spill_job *job, const char *path, struct count_table *t)
+{
+	struct spill_reader r;
+	if (!spill_reader_open(&r, job, path))
+		return false;
+
+	const struct sample *block;
+	int size = 0;
+	while ((block = spill_reader_next(&r, &size))) {
+		for (int i=0; i<size; i++)
+			count_table_add_sample(t, &block[i]);
+	}
+
+	return spill_reader_close(&r);
+}
+
+/* Write the rows of [path] to the spill files of the children, keeping
+ * their order. [pairs] maps the values of [field] to children, sorted by
+ * value. Children are written SPILL_MAX_OPEN at a time, each group in a
+ * pass of its own.
+ */
+static bool
+spill_partition(struct spill_job *job, const char *path, unsigned field,
+				const int *pairs, int npairs, int nchild, char **paths,
+				long *counts)
+{
+	struct spill_writer *w;
+	w = (struct spill_writer*)malloc(sizeof(struct spill_writer) * SPILL_MAX_OPEN);
+	bool ok = true;
+
+	for (int first=0; ok && first<nchild; first+=SPILL_MAX_OPEN) {
+		const int open = nchild - first < SPILL_MAX_OPEN
+						 ? nchild - first : SPILL_MAX_OPEN;
+
+		int opened = 0;
+		for (; opened<open; opened++) {
+			w[opened].file = fopen(paths[first + opened], "w");
+			if (!w[opened].file) {
+				ok = false;
+				break;
+			}
+			w[opened].count = 0;
+			w[opened].rows = (struct sample*)malloc(sizeof(struct sample)
+													* job->block_rows);
+		}
+
+		struct spill_reader r;
+		const bool reading = ok && spill_reader_open(&r, job, path);
+		ok = reading;
+
+		const struct sample *block;
+		int size = 0;
+		while (ok && (block = spill_reader_next(&r, &size))) {
+			for (int i=0; ok && i<size; i++) {
+				const int v = field_value(&block[i], field);
+				const int c = dt_pair_find(pairs, npairs, v);
+				if (c < first || c >= first + open)
+					continue;
+
+				ok = spill_writer_add(job, &w[c - first], &block[i]);
+				counts[c]++;
+			}
+		}
+
+		if (reading)
+			ok = spill_reader_close(&r) && ok;
+
+		for (int i=0; i<opened; i++) {
+			ok = ok && spill_writer_flush(job, &w[i]);
+			ok = (fclose(w[i].file) == 0) && ok;
+			free(w[i].rows);
+		}
+	}
+
+	free(w);
+	return ok;
+}
+
+static char*
+spill_path(struct spill_job *job)
+{
+	char *path = (char*)malloc(strlen(job->dir) + 64);
+	sprintf(path, "%s/dt-spill-%li-%li", job->dir, (long)getpid(), job->seq++);
+	return path;
+}
+
+
+/** Reader **/
+static bool
+spill_reader_open(struct spill_reader *r, const struct spill_job *job,
+				  const char *path)
+{
+	memset(r, 0, sizeof(struct spill_reader));
+	r->job = job;
+	r->file = fopen(path, "r");
+	if (!r->file)
+		return false;
+
+	for (int i=0; i<2; i++)
+		r->rows[i] = (struct sample*)malloc(sizeof(struct sample) * job->block_rows);
+	r->raw = (unsigned char*)malloc(SPILL_ROW_BYTES * job->block_rows);
+
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->cond, NULL);
+	pthread_create(&r->thread, NULL, spill_reader_main, r);
+	return true;
+}
+
+/* Returns the next block, or NULL at the end of the file. The previous
+ * block is handed back to the reader thread.
+ */
+static const struct sample*
+spill_reader_next(struct spill_reader *r, int *count)
+{
+	pthread_mutex_lock(&r->lock);
+	if (r->held) {
+		r->full[r->cur] = false;
+		r->cur ^= 1;
+		r->held = false;
+		pthread_cond_broadcast(&r->cond);
+	}
+
+	while (!r->full[r->cur] && !r->eof)
+		pthread_cond_wait(&r->cond, &r->lock);
+
+	const struct sample *rows = NULL;
+	if (r->full[r->cur]) {
+		rows = r->rows[r->cur];
+		*count = r->count[r->cur];
+		r->held = true;
+	}
+	pthread_mutex_unlock(&r->lock);
+
+	return rows;
+}
+
+/* Stop the reader thread and close the file. Returns false if the file
+ * could not be read.
+ */
+static bool
+spill_reader_close(struct spill_reader *r)
+{
+	pthread_mutex_lock(&r->lock);
+	r->stop = true;
+	pthread_cond_broadcast(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+	pthread_join(r->thread, NULL);
+
+	const bool ok = !r->error;
+	pthread_mutex_destroy(&r->lock);
+	pthread_cond_destroy(&r->cond);
+	fclose(r->file);
+	free(r->rows[0]);
+	free(r->rows[1]);
+	free(r->raw);
+	return ok;
+}
+
+static void*
+spill_reader_main(void *arg)
+{
+	struct spill_reader *r = (struct spill_reader*)arg;
+	const struct spill_job *job = r->job;
+
+	for (int slot=0; ; slot^=1) {
+		pthread_mutex_lock(&r->lock);
+		while (r->full[slot] && !r->stop)
+			pthread_cond_wait(&r->cond, &r->lock);
+		const bool stop = r->stop;
+		pthread_mutex_unlock(&r->lock);
+		if (stop)
+			break;
+
+		// Block header: the number of rows and of encoded bytes
+		int hdr[2];
+		bool eof = false;
+		bool ok = true;
+		size_t n = fread(hdr, sizeof(int), 2, r->file);
+		if (n == 0 && feof(r->file)) {
+			eof = true;
+		} else if (n != 2 || hdr[0] < 0 || hdr[0] > job->block_rows ||
+				   hdr[1] < 0 || hdr[1] > SPILL_ROW_BYTES * hdr[0]) {
+			ok = false;
+		} else {
+			ok = fread(r->raw, 1, hdr[1], r->file) == (size_t)hdr[1] &&
+				 spill_decode(r->raw, hdr[1], hdr[0], job->params->compress,
+							  r->rows[slot]);
+		}
+
+		pthread_mutex_lock(&r->lock);
+		if (eof || !ok) {
+			r->eof = true;
+			r->error = !ok;
+		} else {
+			r->count[slot] = hdr[0];
+			r->full[slot] = true;
+		}
+		pthread_cond_broadcast(&r->cond);
+		pthread_mutex_unlock(&r->lock);
+
+		if (eof || !ok)
+			break;
+	}
+
+	return NULL;
+}
+
+
+/** Writer **/
+static bool
+spill_writer_add(struct spill_job *job, struct spill_writer *w,
+				 const struct sample *s)
+{
+	w->rows[w->count++] = *s;
+	if (w->count == job->block_rows)
+		return spill_writer_flush(job, w);
+	return true;
+}
+
+static bool
+spill_writer_flush(struct spill_job *job, struct spill_writer *w)
+{
+	if (w->count == 0)
+		return true;
+
+	int hdr[2];
+	hdr[0] = w->count;
+	hdr[1] = spill_encode(w->rows, w->count, job->params->compress, job->raw);
+	w->count = 0;
+
+	return fwrite(hdr, sizeof(int), 2, w->file) == 2 &&
+		   fwrite(job->raw, 1, hdr[1], w->file) == (size_t)hdr[1];
+}
+
+
+/** Columns **/
+/* Store the rows one field after the other. Compressed fields are zigzag
+ * varints: seven bits per byte, with small negative values mapped to
+ * small odd numbers.
+ */
+static int
+spill_encode(const struct sample *rows, int count, bool compress,
+			 unsigned char *out)
+{
+	unsigned char *p = out;
+	for (int c=0; c<SPILL_COLUMNS; c++) {
+		for (int i=0; i<count; i++) {
+			const int v = ((const int*)&rows[i])[c];
+			if (!compress) {
+				memcpy(p, &v, sizeof(int));
+				p += sizeof(int);
+				continue;
+			}
+
+			unsigned u = ((unsigned)v << 1) ^ (v < 0 ? ~0u : 0u);
+			while (u >= 0x80) {
+				*p++ = (unsigned char)(u | 0x80);
+				u >>= 7;
+			}
+			*p++ = (unsigned char)u;
+		}
+	}
+
+	return (int)(p - out);
+}
+
+static bool
+spill_decode(const unsigned char *in, int bytes, int count, bool compress,
+			 struct sample *rows)
+{
+	const unsigned char *p = in;
+	const unsigned char *end = in + bytes;
+
+	for (int c=0; c<SPILL_COLUMNS; c++) {
+		for (int i=0; i<count; i++) {
+			int *v = &((int*)&rows[i])[c];
+			if (!compress) {
+				if (end - p < (long)sizeof(int))
+					return false;
+				memcpy(v, p, sizeof(int));
+				p += sizeof(int);
+				continue;
+			}
+
+			unsigned u = 0;
+			int shift = 0;
+			do {
+				if (p == end || shift > 28)
+					return false;
+				u |= (unsigned)(*p & 0x7f) << shift;
+				shift += 7;
+			} while (*p++ & 0x80);
+
+			*v = (int)(u >> 1) ^ -(int)(u & 1);
+		}
+	}
+
+	return p == end;
+}
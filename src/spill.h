@@ -0,0 +1,36 @@
+#ifndef __SPILL_H__
+#define __SPILL_H__
+
+#include "dtree.h"
+
+
+/* Out-of-core training
+ * Trains on a sample file which need not fit in memory. The rows of a
+ * node are kept in a spill file. The node is counted into a count_table
+ * in one pass over the file and split by dt_split_node(). A second pass
+ * then writes its rows, in order, to one spill file per child. Nodes are
+ * trained depth first, and the children of every node on the current
+ * path stay spilled until they are visited. The spill files therefore
+ * hold up to the whole input, and up to twice the rows of the input while
+ * a node is partitioned. Partitions taking less than a quarter of the
+ * memory budget are loaded and trained in memory by dt_create_subtree().
+ *
+ * Spill files are columnar: each block stores its rows one field after
+ * the other. With "compress", each field is stored as zigzag varints,
+ * which takes one byte for small categorical values. A reader thread
+ * fills one block buffer while the other one is counted or partitioned.
+ *
+ * The block buffers are sized by the "memory" budget of dt_params. The
+ * count table of a node is not, and grows with the number of unique
+ * values.
+ *
+ * The input holds one sample per line, as read by sample_parse(). Blank
+ * lines are skipped, and a malformed line fails the training.
+ */
+
+/* Train a tree on the samples in the file [path]. Returns NULL if the
+ * file could not be read or a spill file could not be written.
+ */
+struct decision* dt_create_spilled(const char *path, const struct dt_params*);
+
+#endif /* __SPILL_H__ */
@@ -0,0 +1,138 @@
+#include "sweep.h"
+#include "multi.h"
+#include "inspect.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+
+/* Configurations handed out to the scoring threads in turn */
+struct sweep_job {
+	const struct sample *holdout;
+	int nholdout;
+	struct decision **trees;
+	struct dt_sweep_result *results;
+	int count;
+	int taken;
+	pthread_mutex_t lock;
+};
+
+static void* sweep_score(void*);
+
+
+
+int
+dt_sweep(const struct sample *train, int ntrain,
+		 const struct sample *holdout, int nholdout,
+		 const struct dt_sweep *sweep, struct dt_sweep_result **results)
+{
+	const int count = sweep->n_max_depth * sweep->n_min_leaf * sweep->n_criterion;
+	struct dt_sweep_result *res;
+	res = (struct dt_sweep_result*)malloc(sizeof(struct dt_sweep_result) * (count + 1));
+	struct dt_target *targets;
+	targets = (struct dt_target*)malloc(sizeof(struct dt_target) * (count + 1));
+	struct decision **trees;
+	trees = (struct decision**)malloc(sizeof(struct decision*) * (count + 1));
+	double *seconds = (double*)calloc(count + 1, sizeof(double));
+
+	int n = 0;
+	for (int c=0; c<sweep->n_criterion; c++) {
+		for (int l=0; l<sweep->n_min_leaf; l++) {
+			for (int d=0; d<sweep->n_max_depth; d++) {
+				memset(&res[n], 0, sizeof(struct dt_sweep_result));
+				res[n].params = *sweep->base;
+				res[n].params.max_depth = sweep->max_depth[d];
+				res[n].params.min_leaf = sweep->min_leaf[l];
+				res[n].params.criterion = sweep->criterion[c];
+				n++;
+			}
+		}
+	}
+
+	for (int i=0; i<count; i++) {
+		targets[i].labels = NULL;
+		targets[i].params = &res[i].params;
+	}
+
+	dt_create_targets(train, ntrain, targets, count, sweep->threads,
+					  trees, seconds);
+
+	struct sweep_job job;
+	job.holdout = holdout;
+	job.nholdout = nholdout;
+	job.trees = trees;
+	job.results = res;
+	job.count = count;
+	job.taken = 0;
+	pthread_mutex_init(&job.lock, NULL);
+
+	int threads = sweep->threads < count ? sweep->threads : count;
+	if (threads < 1)
+		threads = 1;
+	pthread_t *workers = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+	for (int i=1; i<threads; i++)
+		pthread_create(&workers[i], NULL, sweep_score, &job);
+	sweep_score(&job);
+	for (int i=1; i<threads; i++)
+		pthread_join(workers[i], NULL);
+	pthread_mutex_destroy(&job.lock);
+
+	for (int i=0; i<count; i++) {
+		res[i].seconds = seconds[i];
+		dt_destroy(trees[i]);
+	}
+
+	free(workers);
+	free(seconds);
+	free(trees);
+	free(targets);
+
+	*results = res;
+	return count;
+}
+
+void
+dt_sweep_print(const struct dt_sweep_result *res, int count, FILE *file)
+{
+	fprintf(file, "depth  min_leaf  criterion   seconds    nodes  accuracy\n");
+	for (int i=0; i<count; i++) {
+		const struct dt_params *p = &res[i].params;
+		if (p->max_depth > 0)
+			fprintf(file, "%5i", p->max_depth);
+		else
+			fprintf(file, "%5s", "-");
+		fprintf(file, "  %8i  %-9s  %8.6f  %7li  %8.4f\n", p->min_leaf,
+				p->criterion == COUNT_GINI ? "gini" : "entropy",
+				res[i].seconds, res[i].nodes, res[i].accuracy);
+	}
+}
+
+
+static void*
+sweep_score(void *arg)
+{
+	struct sweep_job *job = (struct sweep_job*)arg;
+
+	while (true) {
+		pthread_mutex_lock(&job->lock);
+		const int i = job->taken++;
+		pthread_mutex_unlock(&job->lock);
+		if (i >= job->count)
+			break;
+
+		struct dt_stats stats;
+		dt_validate(job->trees[i], &stats);
+		job->results[i].nodes = stats.nodes;
+
+		int correct = 0;
+		for (int j=0; j<job->nholdout; j++) {
+			const struct sample *s = &job->holdout[j];
+			if (dt_decide(job->trees[i], s) == field_value(s, SAMPLE_RESULT_FIELD))
+				correct++;
+		}
+		if (job->nholdout > 0)
+			job->results[i].accuracy = (double)correct / job->nholdout;
+	}
+
+	return NULL;
+}
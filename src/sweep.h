@@ -0,0 +1,45 @@
+#ifndef __SWEEP_H__
+#define __SWEEP_H__
+
+#include "dtree.h"
+
+
+/* Hyperparameter sweep
+ * Trains a tree for every combination of the listed maximum depths,
+ * minimum leaf sizes and criteria in a single dt_create_targets() job.
+ * Configurations share the counting of every node they split alike, so
+ * the levels above the shallowest depth limit are built once for all
+ * depths. The trees are then scored on a holdout set, one configuration
+ * per thread at a time.
+ */
+struct dt_sweep {
+	const struct dt_params *base;	// The other parameters of every tree
+
+	const int *max_depth;
+	int n_max_depth;
+	const int *min_leaf;
+	int n_min_leaf;
+	const enum count_criterion *criterion;
+	int n_criterion;
+
+	int threads;
+};
+
+struct dt_sweep_result {
+	struct dt_params params;
+	double seconds;		// Training time, shared time divided evenly
+	long nodes;
+	double accuracy;	// Share of the holdout set decided correctly
+};
+
+/* Run the sweep, training on [train] and scoring on [holdout]. Returns
+ * the number of configurations and assigns their results to "results",
+ * to be freed by the caller.
+ */
+int dt_sweep(const struct sample *train, int ntrain,
+			 const struct sample *holdout, int nholdout,
+			 const struct dt_sweep*, struct dt_sweep_result **results);
+
+void dt_sweep_print(const struct dt_sweep_result*, int count, FILE*);
+
+#endif /* __SWEEP_H__ */
@@ -0,0 +1,190 @@
+#include "table.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+
+/* The values a tree tests on one field */
+struct table_values {
+	int *v;
+	int n;
+	int cap;
+};
+
+static void table_collect(const struct decision*, struct table_values*);
+static void table_add(struct table_values*, int value);
+static bool table_build(struct dt_table*, struct table_values*, long max_size);
+
+
+
+struct dt_table*
+dt_compile(const struct decision *dec, long max_size)
+{
+	struct dt_table *t = (struct dt_table*)malloc(sizeof(struct dt_table));
+	memset(t, 0, sizeof(struct dt_table));
+	t->tree = dec;
+
+	struct table_values vals[SAMPLE_NUM_FIELDS];
+	memset(vals, 0, sizeof(vals));
+	table_collect(dec, vals);
+
+	// Sort the tested values, and drop the duplicates
+	for (int f=0; f<SAMPLE_NUM_FIELDS; f++) {
+		struct table_values *tv = &vals[f];
+		if (tv->n == 0)
+			continue;
+		qsort(tv->v, tv->n, sizeof(int), int_cmp);
+		int n = 0;
+		for (int i=0; i<tv->n; i++) {
+			if (n == 0 || tv->v[n-1] != tv->v[i])
+				tv->v[n++] = tv->v[i];
+		}
+		tv->n = n;
+	}
+
+	if (!table_build(t, vals, max_size)) {
+		for (int f=0; f<SAMPLE_NUM_FIELDS; f++) {
+			free(t->offset[f]);
+			t->offset[f] = NULL;
+		}
+		free(t->decisions);
+		t->decisions = NULL;
+		t->size = 0;
+	}
+
+	for (int f=0; f<SAMPLE_NUM_FIELDS; f++)
+		free(vals[f].v);
+	return t;
+}
+
+void
+dt_table_decide_batch(const struct dt_table *t, const struct sample *samples,
+					  int count, int *out)
+{
+	if (!t->decisions) {
+		dt_decide_batch(t->tree, samples, count, out);
+		return;
+	}
+
+	for (int i=0; i<count; i++)
+		out[i] = dt_table_decide(t, &samples[i]);
+}
+
+void
+dt_table_destroy(struct dt_table *t)
+{
+	if (!t)
+		return;
+
+	for (int f=0; f<SAMPLE_NUM_FIELDS; f++)
+		free(t->offset[f]);
+	free(t->decisions);
+	free(t);
+}
+
+
+/* Append the values tested by every branch of the tree to the field they
+ * test. Leaves test nothing.
+ */
+static void
+table_collect(const struct decision *dec, struct table_values *vals)
+{
+	if (!dec || !dec->dest)
+		return;
+
+	for (const struct decision *d = dec; d; d=d->next) {
+		if (d->set) {
+			for (int i=0; i<d->set_size; i++)
+				table_add(&vals[d->field], d->set[i]);
+		} else {
+			table_add(&vals[d->field], d->value);
+		}
+		table_collect(d->dest, vals);
+	}
+}
+
+static void
+table_add(struct table_values *tv, int value)
+{
+	if (tv->n == tv->cap) {
+		tv->cap = tv->cap ? tv->cap * 2 : 16;
+		tv->v = (int*)realloc(tv->v, sizeof(int) * tv->cap);
+	}
+	tv->v[tv->n++] = value;
+}
+
+/* Lay out the digits of the fields and decide every point of the domain.
+ * Returns false if the domain does not fit in [max_size] decisions.
+ */
+static bool
+table_build(struct dt_table *t, struct table_values *vals, long max_size)
+{
+	// Field [f] has vals[f].n tested values, and one digit for the rest
+	long stride[SAMPLE_NUM_FIELDS];
+	long size = 1;
+	for (int f=0; f<SAMPLE_NUM_FIELDS; f++) {
+		stride[f] = size;
+		if (vals[f].n == 0)
+			continue;
+
+		const long long range = (long long)vals[f].v[vals[f].n-1]
+								- vals[f].v[0] + 1;
+		const long card = vals[f].n + 1;
+		if (range > max_size || size > max_size / card)
+			return false;
+		size *= card;
+	}
+
+	// The value of a field standing in for all the untested ones
+	int rest[SAMPLE_NUM_FIELDS];
+	for (int f=0; f<SAMPLE_NUM_FIELDS; f++) {
+		const struct table_values *tv = &vals[f];
+		if (tv->n == 0)
+			continue;
+
+		t->min[f] = tv->v[0];
+		t->range[f] = (unsigned)tv->v[tv->n-1] - (unsigned)tv->v[0] + 1;
+		t->other[f] = tv->n * stride[f];
+		t->offset[f] = (long*)malloc(sizeof(long) * t->range[f]);
+		for (unsigned i=0; i<t->range[f]; i++)
+			t->offset[f][i] = t->other[f];
+		for (int i=0; i<tv->n; i++) {
+			const unsigned d = (unsigned)tv->v[i] - (unsigned)t->min[f];
+			t->offset[f][d] = i * stride[f];
+		}
+
+		rest[f] = tv->v[0] > INT_MIN ? tv->v[0] - 1 : tv->v[tv->n-1] + 1;
+	}
+
+	t->size = size;
+	t->decisions = (int*)malloc(sizeof(int) * size);
+
+	// Count through the domain in mixed radix, the first field fastest
+	int digit[SAMPLE_NUM_FIELDS];
+	struct sample sample;
+	memset(&sample, 0, sizeof(sample));
+	int *v = (int*)&sample;
+	for (int f=0; f<SAMPLE_NUM_FIELDS; f++) {
+		digit[f] = 0;
+		if (vals[f].n > 0)
+			v[f] = vals[f].v[0];
+	}
+
+	for (long i=0; i<size; i++) {
+		t->decisions[i] = dt_decide(t->tree, &sample);
+
+		for (int f=0; f<SAMPLE_NUM_FIELDS; f++) {
+			if (vals[f].n == 0)
+				continue;
+			if (digit[f] < vals[f].n) {
+				digit[f]++;
+				v[f] = digit[f] < vals[f].n ? vals[f].v[digit[f]] : rest[f];
+				break;
+			}
+			digit[f] = 0;
+			v[f] = vals[f].v[0];
+		}
+	}
+
+	return true;
+}
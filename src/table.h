@@ -0,0 +1,65 @@
+#ifndef __TABLE_H__
+#define __TABLE_H__
+
+#include "dtree.h"
+
+
+/* Lookup-table compilation
+ * A tree only distinguishes the values of a field that it tests. Every
+ * other value fails all its tests alike, so the domain of a field is the
+ * tested values plus one digit for the rest. When the product of these
+ * cardinalities is small, dt_compile() decides every point of the domain
+ * up front into a dense table, indexed in mixed radix by the digits of
+ * the fields. Deciding a sample then takes one lookup per field and one
+ * load, however deep the tree.
+ *
+ * Larger domains are not compiled, and dt_table_decide() falls back to
+ * dt_decide() on the tree.
+ */
+
+struct dt_table {
+	const struct decision *tree;	// Decides if "decisions" is NULL
+	int *decisions;
+	long size;
+
+	// The offset in "decisions" of value min[f]+i of field [f] is
+	// offset[f][i], and other[f] for values outside the range. Fields
+	// the tree does not test have no offsets.
+	long *offset[SAMPLE_NUM_FIELDS];
+	int min[SAMPLE_NUM_FIELDS];
+	unsigned range[SAMPLE_NUM_FIELDS];
+	long other[SAMPLE_NUM_FIELDS];
+};
+
+/* Compile a fully grown tree into a table of at most [max_size]
+ * decisions. The tree has to outlive the table, which falls back to it
+ * if the domain has more points, or a field's tested values span more
+ * than [max_size] integers.
+ */
+struct dt_table* dt_compile(const struct decision*, long max_size);
+
+static inline int
+dt_table_decide(const struct dt_table *t, const struct sample *sample)
+{
+	if (!t->decisions)
+		return dt_decide(t->tree, sample);
+
+	const int *v = (const int*)sample;
+	long i = 0;
+	for (int f=0; f<SAMPLE_NUM_FIELDS; f++) {
+		if (!t->offset[f])
+			continue;
+		const unsigned d = (unsigned)v[f] - (unsigned)t->min[f];
+		i += d < t->range[f] ? t->offset[f][d] : t->other[f];
+	}
+
+	return t->decisions[i];
+}
+
+// Decide [count] samples, writing the decisions to "out"
+void dt_table_decide_batch(const struct dt_table*, const struct sample*,
+						   int count, int *out);
+
+void dt_table_destroy(struct dt_table*);
+
+#endif /* __TABLE_H__ */